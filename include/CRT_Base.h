@@ -22,10 +22,12 @@
 #include <string>
 #include <cstring>
 #include <array>
+#include <memory>
 
 #include "strtk.hpp"
 #include "CRT_shared.h"
 #include "cft_base.h"
+#include "complex_kernels.h"
 #include "ParameterHandler.h"
 
 using namespace std;
@@ -58,6 +60,7 @@ public:
   void Save( fftw_complex *, std::string );
   void Save_Phi( std::string, const int comp=0 );
   void Append_Phi( std::string, const int comp=0 );
+  void Wait_Output();
   void Dump_2( ofstream & );
 
   void Set_custom_fct( StepFunction &fct)
@@ -98,6 +101,12 @@ protected:
   void LoadFiles();
 
   bool m_potenial_initialized;
+  /// Format version of the written binary files (SIMULATION key FILE_FORMAT, see File_Format)
+  int m_file_format;
+  /// Background writer for the binary files (SIMULATION key IO_BACKEND "async", nullptr otherwise)
+  std::unique_ptr<Output::Async_Writer> m_async_output;
+
+  void Write_Field( const std::string &, const fftw_complex *, const bool );
 
   virtual bool run_custom_sequence( const sequence_item & )=0;
 
@@ -155,6 +164,19 @@ CRT_Base<T,dim,no_int_states>::CRT_Base( ParameterHandler *params )
   m_map_stepfcts["freeprop_lin"] = &Do_NL_Step_Wrapper_one;
   m_custom_fct=nullptr;
   m_potenial_initialized=false;
+  m_file_format = m_params->Get_File_Format();
+  if ( m_params->Get_IO_Backend() == "async" )
+  {
+    if ( m_fields[0]->Is_Distributed() )
+    {
+      std::cout << "FYI: IO_BACKEND async is not available for distributed grids, using MPI-IO\n";
+    }
+    else
+    {
+      m_async_output.reset( new Output::Async_Writer() );
+      std::cout << "FYI: asynchronous output with " << (( m_async_output->Uses_IO_Uring() ) ? ("io_uring") : ("pwrite threads")) << "\n";
+    }
+  }
 
   m_L = 1;
   m_T = m_params->Get_t_scale();
@@ -190,6 +212,8 @@ void CRT_Base<T,dim,no_int_states>::Allocate()
     m_fields[i] = new T( m_header );
     m_fields[i]->SetFix(false);
   }
+  // a distributed transform holds only a part of the grid
+  m_no_of_pts = m_fields[0]->Get_Dim_RS();
 
   m_full_step = (fftw_complex *)fftw_malloc( sizeof(fftw_complex)*m_no_of_pts );
   m_half_step = (fftw_complex *)fftw_malloc( sizeof(fftw_complex)*m_no_of_pts );
@@ -203,12 +227,14 @@ template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::LoadFiles()
 {
   ifstream in;
+  generic_header header;
 
   //File 1
   in.open( m_params->Get_simulation("FILENAME"), ifstream::binary );
   if ( in.is_open() )
   {
-    in.seekg( sizeof(generic_header), ifstream::beg );
+    const uint64_t data_offset = File_Format::Read_Header( in, header );
+    in.seekg( data_offset+m_fields[0]->Get_Offset_RS()*sizeof(fftw_complex), ifstream::beg );
     in.read( (char *)m_fields[0]->Getp2In(), sizeof(fftw_complex)*m_no_of_pts );
     in.close();
   }
@@ -224,7 +250,8 @@ void CRT_Base<T,dim,no_int_states>::LoadFiles()
     in.open( m_params->Get_simulation(str), ifstream::binary );
     if ( in.is_open() )
     {
-      in.seekg( sizeof(generic_header), ifstream::beg );
+      const uint64_t data_offset = File_Format::Read_Header( in, header );
+      in.seekg( data_offset+m_fields[i]->Get_Offset_RS()*sizeof(fftw_complex), ifstream::beg );
       in.read( (char *)m_fields[i]->Getp2In(), sizeof(fftw_complex)*m_no_of_pts );
       in.close();
     }
@@ -248,23 +275,41 @@ void CRT_Base<T,dim,no_int_states>::LoadFiles()
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Init()
 {
+  // alpha_i k_i^2 along each axis
+  std::array<std::vector<double>,dim> ekin;
+  for ( int d=0; d<dim; d++ )
+  {
+    const double *k = m_fields[0]->Get_k_Table(d);
+    const int n = ( d==0 ) ? (m_fields[0]->Get_Dim_X()) : ( ( d==1 ) ? (m_fields[0]->Get_Dim_Y()) : (m_fields[0]->Get_Dim_Z()) );
+    ekin[d].resize(n);
+    for ( int i=0; i<n; i++ )
+      ekin[d][i] = (k[i]*m_alpha[d])*k[i];
+  }
+
   #pragma omp parallel
   {
     const double dt = -m_header.dt;
-    double phi;
-
-    CPoint<dim> k;
+    double phi[Fourier::cft_base<dim>::TILE_LENGTH];
+    double half_phi[Fourier::cft_base<dim>::TILE_LENGTH];
 
     #pragma omp for
-    for ( int i=0; i<m_no_of_pts; i++ )
+    for ( int64_t t=0; t<m_fields[0]->Get_No_Tiles(); t++ )
     {
-      k = m_fields[0]->Get_k(i);
-      phi = dt*(k.scale(m_alpha)*k);
+      const Fourier::grid_tile tile = m_fields[0]->Get_Tile(t);
+
+      double e_outer = 0;
+      for ( int d=0; d<dim-1; d++ )
+        e_outer += ekin[d][tile.idx[d]];
+      const double *e_last = ekin[dim-1].data() + tile.idx[dim-1];
+
+      for ( int m=0; m<tile.n; m++ )
+      {
+        phi[m] = dt*(e_outer+e_last[m]);
+        half_phi[m] = 0.5*phi[m];
+      }
 
-      m_half_step[i][0] = cos(0.5*phi);
-      m_half_step[i][1] = sin(0.5*phi);
-      m_full_step[i][0] = cos(phi);
-      m_full_step[i][1] = sin(phi);
+      Kernels::Exp_Phase( phi, m_full_step+tile.l0, tile.n );
+      Kernels::Exp_Phase( half_phi, m_half_step+tile.l0, tile.n );
     }
   }
 }
@@ -336,18 +381,15 @@ void CRT_Base<T,dim,no_int_states>::Do_FT_Step_full()
   for ( int c=0; c<no_int_states; c++ )
     m_fields[c]->ft(-1);
 
-  double tmp1;
-
   for ( int i=0; i<no_int_states; i++ )
   {
     fftw_complex *Psi = m_fields[i]->Getp2In();
 
-    #pragma omp parallel for private(tmp1)
-    for ( int l=0; l<m_no_of_pts; l++ )
+    #pragma omp parallel for
+    for ( int64_t t=0; t<m_fields[i]->Get_No_Tiles(); t++ )
     {
-      tmp1 = Psi[l][0];
-      Psi[l][0] = Psi[l][0]*m_full_step[l][0] - Psi[l][1]*m_full_step[l][1];
-      Psi[l][1] = Psi[l][1]*m_full_step[l][0] + tmp1*m_full_step[l][1];
+      const Fourier::grid_tile tile = m_fields[i]->Get_Tile(t);
+      Kernels::Multiply( Psi+tile.l0, m_full_step+tile.l0, tile.n );
     }
   }
   //Fourier transform back into real space
@@ -365,18 +407,16 @@ void CRT_Base<T,dim,no_int_states>::Do_FT_Step_half()
   //Fourier transform
   for ( int c=0; c<no_int_states; c++ )
     m_fields[c]->ft(-1);
-  double tmp1;
 
   for ( int i=0; i<no_int_states; i++ )
   {
     fftw_complex *Psi = m_fields[i]->Getp2In();
 
-    #pragma omp parallel for private(tmp1)
-    for ( int l=0; l<m_no_of_pts; l++ )
+    #pragma omp parallel for
+    for ( int64_t t=0; t<m_fields[i]->Get_No_Tiles(); t++ )
     {
-      tmp1 = Psi[l][0];
-      Psi[l][0] = Psi[l][0]*m_half_step[l][0] - Psi[l][1]*m_half_step[l][1];
-      Psi[l][1] = Psi[l][1]*m_half_step[l][0] + tmp1*m_half_step[l][1];
+      const Fourier::grid_tile tile = m_fields[i]->Get_Tile(t);
+      Kernels::Multiply( Psi+tile.l0, m_half_step+tile.l0, tile.n );
     }
   }
 
@@ -394,47 +434,27 @@ void CRT_Base<T,dim,no_int_states>::Do_NL_Step()
 {
   const double dt = -m_header.dt;
 
+  if ( !m_potenial_initialized ) return;
+
   #pragma omp parallel
   {
-    double re1, im1, tmp1, phi[no_int_states];
-
-    vector<fftw_complex *> Psi;
-    for ( int i=0; i<no_int_states; i++ )
-      Psi.push_back(m_fields[i]->Getp2In());
+    double phi[Fourier::cft_base<dim>::TILE_LENGTH];
 
     #pragma omp for
-    for ( int l=0; l<m_no_of_pts; l++ )
+    for ( int64_t t=0; t<m_fields[0]->Get_No_Tiles(); t++ )
     {
-      for ( int i=0; i<no_int_states; i++ )
-      {
-        if ( m_potenial_initialized )
-        {
-          phi[i] = m_Potential[i][l];
-        }
-        else
-        {
-          phi[i] = 0;
-        }
-    	double tmp_density = Psi[i][l][0]*Psi[i][l][0] + Psi[i][l][1]*Psi[i][l][1];
-    	if (tmp_density <= 0.0)
-    	{
-    		phi[i] += 0.0;
-    	} else
-    	{
-    		//phi[i] += -this->m_b*log( tmp_density );
-      	//phi[i] += this->m_gs[no_int_states*i]*tmp_density;
-    	}
-        phi[i] *= dt;
-      }
+      const Fourier::grid_tile tile = m_fields[0]->Get_Tile(t);
 
-      //exp(V)*Psi
       for ( int i=0; i<no_int_states; i++ )
       {
-        sincos( phi[i], &im1, &re1 );
-
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+        const double *V = m_Potential[i].data() + tile.l0;
+        for ( int m=0; m<tile.n; m++ )
+          phi[m] = dt*V[m];
+        //phi[i] += -this->m_b*log( tmp_density );
+        //phi[i] += this->m_gs[no_int_states*i]*tmp_density;
+
+        //exp(V)*Psi
+        Kernels::Multiply_Phase( m_fields[i]->Getp2In()+tile.l0, phi, tile.n );
       }
     }
   }
@@ -450,24 +470,25 @@ void CRT_Base<T,dim,no_int_states>::Setup_Momentum( CPoint<dim> px, const int co
 {
   if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
 
+  const double dx[3] = { m_header.dx, m_header.dy, m_header.dz };
+  const double dphi = px[dim-1]*dx[dim-1];
+
   #pragma omp parallel
   {
-    CPoint<dim> x;
-    double re, im, re2, im2;
-
     fftw_complex *Psi = m_fields[comp]->Getp2In();
+    const double *x_last = m_fields[comp]->Get_x_Table(dim-1);
 
     #pragma omp for
-    for ( int l=0; l<m_no_of_pts; l++ )
+    for ( int64_t t=0; t<m_fields[comp]->Get_No_Tiles(); t++ )
     {
-      x = this->m_fields[comp]->Get_x(l);
-      //exp(p*x)
-      sincos(px*x,&im,&re);
-
-      re2 = Psi[l][0];
-      im2 = Psi[l][1];
-      Psi[l][0] = re2*re-im2*im;
-      Psi[l][1] = re2*im+im2*re;
+      const Fourier::grid_tile tile = m_fields[comp]->Get_Tile(t);
+
+      double px_outer = 0;
+      for ( int d=0; d<dim-1; d++ )
+        px_outer += px[d]*m_fields[comp]->Get_x_Table(d)[tile.idx[d]];
+
+      //exp(p*x), linear in x along the tile
+      Kernels::Multiply_Linear_Phase( Psi+tile.l0, px_outer+px[dim-1]*x_last[tile.idx[dim-1]], dphi, tile.n );
     }
   }
 }
@@ -490,8 +511,8 @@ void CRT_Base<T,dim,no_int_states>::Expval_Position( CPoint<dim> &retval, const
     const int ithread = omp_get_thread_num();
 
     double den;
-    CPoint<dim> x;
     fftw_complex *Psi = m_fields[comp]->Getp2In();
+    const double *x_last = m_fields[comp]->Get_x_Table(dim-1);
 
     #pragma omp single
     {
@@ -500,12 +521,21 @@ void CRT_Base<T,dim,no_int_states>::Expval_Position( CPoint<dim> &retval, const
     }
 
     #pragma omp for
-    for ( int l=0; l<m_no_of_pts; l++ )
+    for ( int64_t t=0; t<m_fields[comp]->Get_No_Tiles(); t++ )
     {
-      x = m_fields[comp]->Get_x(l);
-      den = (Psi[l][0]*Psi[l][0]+Psi[l][1]*Psi[l][1]);
-      for (int i=0; i<dim; i++ )
-        tmp[ithread*dim+i] += x[i]*den;
+      const Fourier::grid_tile tile = m_fields[comp]->Get_Tile(t);
+
+      double sum = 0, sum_last = 0;
+      for ( int m=0; m<tile.n; m++ )
+      {
+        const int64_t l = tile.l0+m;
+        den = (Psi[l][0]*Psi[l][0]+Psi[l][1]*Psi[l][1]);
+        sum += den;
+        sum_last += x_last[tile.idx[dim-1]+m]*den;
+      }
+      for (int i=0; i<dim-1; i++ )
+        tmp[ithread*dim+i] += m_fields[comp]->Get_x_Table(i)[tile.idx[i]]*sum;
+      tmp[ithread*dim+dim-1] += sum_last;
     }
 
     #pragma omp for
@@ -521,7 +551,7 @@ void CRT_Base<T,dim,no_int_states>::Expval_Position( CPoint<dim> &retval, const
   delete [] tmp;
 
   for (int i=0; i<dim; i++ )
-    retval[i] = m_ar*res[i];
+    retval[i] = m_ar*m_fields[comp]->Sum(res[i]);
 }
 
 /** Calculate the expectation value of the momentum of an internal state
@@ -543,8 +573,8 @@ void CRT_Base<T,dim,no_int_states>::Expval_Momentum( CPoint<dim> &retval, const
     const int ithread = omp_get_thread_num();
 
     double den;
-    CPoint<dim> k;
     fftw_complex *Psi = m_fields[comp]->Getp2In();
+    const double *k_last = m_fields[comp]->Get_k_Table(dim-1);
 
     #pragma omp single
     {
@@ -553,12 +583,21 @@ void CRT_Base<T,dim,no_int_states>::Expval_Momentum( CPoint<dim> &retval, const
     }
 
     #pragma omp for
-    for ( int l=0; l<m_no_of_pts; l++ )
+    for ( int64_t t=0; t<m_fields[comp]->Get_No_Tiles(); t++ )
     {
-      k = m_fields[comp]->Get_k(l);
-      den = (Psi[l][0]*Psi[l][0]+Psi[l][1]*Psi[l][1]);
-      for (int i=0; i<dim; i++ )
-        tmp[ithread*dim+i] += k[i]*den;
+      const Fourier::grid_tile tile = m_fields[comp]->Get_Tile(t);
+
+      double sum = 0, sum_last = 0;
+      for ( int m=0; m<tile.n; m++ )
+      {
+        const int64_t l = tile.l0+m;
+        den = (Psi[l][0]*Psi[l][0]+Psi[l][1]*Psi[l][1]);
+        sum += den;
+        sum_last += k_last[tile.idx[dim-1]+m]*den;
+      }
+      for (int i=0; i<dim-1; i++ )
+        tmp[ithread*dim+i] += m_fields[comp]->Get_k_Table(i)[tile.idx[i]]*sum;
+      tmp[ithread*dim+dim-1] += sum_last;
     }
 
     #pragma omp for
@@ -576,7 +615,7 @@ void CRT_Base<T,dim,no_int_states>::Expval_Momentum( CPoint<dim> &retval, const
   m_fields[comp]->ft(1);
 
   for (int i=0; i<dim; i++ )
-    retval[i] = m_ar_k*res[i];
+    retval[i] = m_ar_k*m_fields[comp]->Sum(res[i]);
 }
 
 /** Compute the number of particles of an internal state
@@ -591,11 +630,12 @@ double CRT_Base<T,dim,no_int_states>::Get_Particle_Number( const int comp )
   fftw_complex *Psi=m_fields[comp]->Getp2In();
   double retval=0.0;
   #pragma omp parallel for reduction(+:retval)
-  for ( int l=0; l<m_no_of_pts; l++ )
+  for ( int64_t t=0; t<m_fields[comp]->Get_No_Tiles(); t++ )
   {
-    retval += (Psi[l][0]*Psi[l][0] + Psi[l][1]*Psi[l][1]);
+    const Fourier::grid_tile tile = m_fields[comp]->Get_Tile(t);
+    retval += Kernels::Norm2( Psi+tile.l0, tile.n );
   }
-  return m_ar*retval;
+  return m_ar*m_fields[comp]->Sum(retval);
 }
 
 /** Write an internal state to a binary file
@@ -608,13 +648,7 @@ void CRT_Base<T,dim,no_int_states>::Save_Phi( std::string filename, const int co
 {
   if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
 
-  char *header = reinterpret_cast<char *>(&m_header);
-  char *Psi = reinterpret_cast<char *>(m_fields[comp]->Getp2In());
-
-  ofstream file1( filename, ofstream::binary );
-  file1.write( header, sizeof(generic_header) );
-  file1.write( Psi, m_no_of_pts*sizeof(fftw_complex) );
-  file1.close();
+  Write_Field( filename, m_fields[comp]->Getp2In(), false );
 }
 
 /** Append an internal state to a binary file
@@ -627,17 +661,33 @@ void CRT_Base<T,dim,no_int_states>::Append_Phi( std::string filename, const int
 {
   if ( comp<0 || comp>no_int_states ) throw std::string("Error in " + std::string(__func__) + ": comp out of bounds\n");
 
-  char *header = reinterpret_cast<char *>(&m_header);
-  char *Psi = reinterpret_cast<char *>(m_fields[comp]->Getp2In());
+  Write_Field( filename, m_fields[comp]->Getp2In(), true );
+}
 
-  ofstream file1( filename, ofstream::binary | ofstream::app );
-  if (file1.fail()) {
-    cout << "File " << filename << " could not be opened. Failbit: " << file1.rdstate() << endl;
-    exit(EXIT_FAILURE);
+/** Write a header and the complex values of the grid to a binary file
+  *
+  * The frame is written directly (see Fourier::cft_base::Write_Data) or queued in #m_async_output.
+  * @param filename
+  * @param data Write content of data to file. Number of elements of data must be the same as m_no_of_pts
+  * @param append Append to the file instead of replacing it
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Write_Field( const std::string &filename, const fftw_complex *data, const bool append )
+{
+  if ( m_async_output == nullptr )
+  {
+    m_fields[0]->Write_Data( filename, m_header, data, append, m_file_format );
+    return;
   }
-  file1.write( header, sizeof(generic_header) );
-  file1.write( Psi, m_no_of_pts*sizeof(fftw_complex) );
-  file1.close();
+  const std::vector<char> block = File_Format::Encode( m_header, m_file_format );
+  m_async_output->Submit( filename, block.data(), block.size(), data, sizeof(fftw_complex)*m_no_of_pts, append, File_Format::Alignment(m_file_format) );
+}
+
+/// Wait until all binary files are written (only needed with IO_BACKEND async)
+template <class T, int dim, int no_int_states>
+void CRT_Base<T,dim,no_int_states>::Wait_Output()
+{
+  if ( m_async_output != nullptr ) m_async_output->Wait();
 }
 
 /** Write an array of doubles to a binary file
@@ -668,13 +718,7 @@ void CRT_Base<T,dim,no_int_states>::Save( double *data, std::string filename )
 template <class T, int dim, int no_int_states>
 void CRT_Base<T,dim,no_int_states>::Save( fftw_complex *data, std::string filename )
 {
-  char *header = reinterpret_cast<char *>(&m_header);
-  char *Psi = reinterpret_cast<char *>(data);
-
-  ofstream file1( filename, ofstream::binary );
-  file1.write( header, sizeof(generic_header) );
-  file1.write( Psi, m_no_of_pts*sizeof(fftw_complex) );
-  file1.close();
+  Write_Field( filename, data, false );
 }
 
 /** Run all the sequences defined in the xml file
@@ -838,6 +882,7 @@ void CRT_Base<T,dim,no_int_states>::run_sequence()
 
     seq_counter++;
   } // end of sequence loop
+  Wait_Output();
 }
 
 /// Defines Output for << operator for CRT_Base objects
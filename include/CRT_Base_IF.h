@@ -20,9 +20,15 @@
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
 #include <array>
+#include <map>
+#include <memory>
 
 #include "CRT_Base.h"
+#include "autotune.h"
 #include "ParameterHandler.h"
 #include "gsl/gsl_complex_math.h"
 #include "gsl/gsl_eigen.h"
@@ -34,6 +40,72 @@ using namespace std;
 #ifndef __class_CRT_Base_IF__
 #define __class_CRT_Base_IF__
 
+/** Exponential \f$ \exp(-iH) \f$ of a hermitian <B>N</B> x <B>N</B> matrix via numerical diagonalisation
+  *
+  * Holds the gsl workspaces, so that one object (per thread) can be reused for many matrices.
+  */
+template <int N>
+class Hermitian_Exponential
+{
+public:
+  Hermitian_Exponential();
+  ~Hermitian_Exponential();
+  Hermitian_Exponential( const Hermitian_Exponential & ) = delete;
+  Hermitian_Exponential & operator=( const Hermitian_Exponential & ) = delete;
+
+  void Compute( gsl_matrix_complex *, gsl_complex * );
+
+protected:
+  gsl_matrix_complex *m_B;
+  gsl_matrix_complex *m_evec;
+  gsl_vector *m_eval;
+  gsl_eigen_hermv_workspace *m_w;
+};
+
+template <int N>
+Hermitian_Exponential<N>::Hermitian_Exponential()
+{
+  m_B = gsl_matrix_complex_calloc(N,N);
+  m_evec = gsl_matrix_complex_alloc(N,N);
+  m_eval = gsl_vector_alloc(N);
+  m_w = gsl_eigen_hermv_alloc(N);
+}
+
+template <int N>
+Hermitian_Exponential<N>::~Hermitian_Exponential()
+{
+  gsl_matrix_complex_free(m_B);
+  gsl_matrix_complex_free(m_evec);
+  gsl_vector_free(m_eval);
+  gsl_eigen_hermv_free(m_w);
+}
+
+/** Computes \f$ U = \exp(-iH) = E \exp(-i\Lambda) E^\dagger \f$
+  *
+  * @param H Hermitian matrix, only the lower triangle and the diagonal are used. H is overwritten.
+  * @param U Result in row-major order (N*N entries)
+  */
+template <int N>
+void Hermitian_Exponential<N>::Compute( gsl_matrix_complex *H, gsl_complex *U )
+{
+  double re1, im1;
+
+  gsl_eigen_hermv(H,m_eval,m_evec,m_w);
+
+  gsl_matrix_complex_set_zero(m_B);
+  for ( int i=0; i<N; i++ )
+  {
+    sincos( -gsl_vector_get(m_eval,i), &im1, &re1 );
+    gsl_matrix_complex_set(m_B,i,i, {re1,im1});
+  }
+  gsl_blas_zgemm(CblasNoTrans,CblasConjTrans,GSL_COMPLEX_ONE,m_B,m_evec,GSL_COMPLEX_ZERO,H);
+  gsl_blas_zgemm(CblasNoTrans,CblasNoTrans,GSL_COMPLEX_ONE,m_evec,H,GSL_COMPLEX_ZERO,m_B);
+
+  for ( int i=0; i<N; i++ )
+    for ( int j=0; j<N; j++ )
+      U[i*N+j] = gsl_matrix_complex_get(m_B,i,j);
+}
+
 /** Template class for interferometry in <B>dim</B> dimensions with <B>no_int_states</B> internal states
   *
   * In this template class functions for the interaction of a BEC with a light field are defined.
@@ -46,12 +118,14 @@ public:
   virtual ~CRT_Base_IF();
 
   void run_sequence();
+  void plan_sequence();
 
 protected:
   using CRT_Base<T,dim,no_int_states>::m_header;
   using CRT_Base<T,dim,no_int_states>::m_params;
   using CRT_Base<T,dim,no_int_states>::m_fields;
   using CRT_Base<T,dim,no_int_states>::m_custom_fct;
+  using CRT_Base<T,dim,no_int_states>::m_Potential;
   using CRT_shared::m_no_of_pts;
 
   CPoint<dim> x;
@@ -63,17 +137,140 @@ protected:
   bool position_dependent;
   bool time_dependent;
   bool nonlinear;
+  /// Native GPE term with the matrix m_gs (sequence attribute gpe)
+  bool m_gpe;
+  /// The potential of the sequence is time independent and linear and is cached in m_Potential
+  bool m_static_potential;
+  /// Uniform phases of the internal states that are not yet applied to the fields, see Apply_Global_Phases()
+  std::array<double,no_int_states> m_global_phase;
+  bool m_global_phase_pending;
+  /// Potential or internal step that Sub_Cycled_Step() calls m_sub_steps times per kinetic step (0: Adaptive_Substeps())
+  StepFunction m_sub_step_fct;
+  int m_sub_steps;
+  /// Largest phase change of the Hamiltonian within one sub-step for substeps="auto"
+  static constexpr double SUBSTEP_PHASE = 0.05;
+  static const int MAX_SUBSTEPS = 1000;
+  /// Number of grid points on which Adaptive_Substeps() evaluates the Hamiltonian (per process)
+  static const int SUBSTEP_PROBES = 512;
+  /// Commutator-free Magnus integrator of order 4 for the internal Hamiltonian (sequence attribute integrator="magnus4")
+  bool m_magnus;
+  /// Distance of the two Gauss nodes of the Magnus integrator from the midpoint of the step in units of dt (sqrt(3)/6)
+  static constexpr double MAGNUS_NODE = 0.28867513459481288;
 
   mu::Parser* V_parser;
 
   static void Do_NL_Step_Wrapper(void *,sequence_item &);
   static void Numerical_Diagonalization_Wrapper(void *,sequence_item &);
+  static void Plane_Wave_Step_Wrapper(void *,sequence_item &);
+  static void Do_FT_Step_full_Frame_Wrapper(void *,sequence_item &);
+  static void Do_FT_Step_half_Frame_Wrapper(void *,sequence_item &);
+  static void Sub_Cycled_Step_Wrapper(void *,sequence_item &);
 
   void Do_NL_Step();
   void Numerical_Diagonalization();
+  void Momentum_Lattice_Step();
+  void Plane_Wave_Step();
+  void Uniform_Propagator( const double, const double, const bool, gsl_complex * );
+  void Uniform_Exponential( const double *, const double, const bool, gsl_complex * );
+  void Magnus_Weights( double [2][2] );
+  void Apply_Uniform_Propagator( const gsl_complex * );
+  void Apply_Kinetic_Phase( const double );
+  void Exact_Block( const int, const double, const bool );
+  void Do_FT_Step_Frame( const bool );
+  void Sub_Cycled_Step( sequence_item & );
+  int Adaptive_Substeps();
+
+  void Setup_Plane_Wave_Coupling( const sequence_item & );
+  void Setup_Plane_Wave_Frame();
+  void Free_Plane_Wave_Frame();
+  void Change_Frame( const bool );
+  int64_t Shift_Tile( const Fourier::grid_tile &, const int, int [3] );
+
+  void Setup_GPE();
+  void Cache_Static_Potential();
+  void Apply_Global_Phases();
+  void Add_Nonlinear_Phase( const Fourier::grid_tile &, const double, const double *, double [][Fourier::cft_base<dim>::TILE_LENGTH] );
+  void Setup_Convolution( const sequence_item & );
+  void Free_Convolution();
+  void Compute_Convolution();
+  int64_t Conv_Offset( const Fourier::grid_tile & ) const;
+  void Record_Observables( const sequence_item & );
 
   void UpdateParams();
 
+  /// Momentum offset of each internal state (coupling_orders times coupling_k)
+  std::array<CPoint<dim>,no_int_states> m_coupling_p;
+  /// Momentum offset of each internal state in units of the k-space grid spacing
+  std::array<std::array<int,dim>,no_int_states> m_coupling_shift;
+  /// Cached momentum-lattice propagators for time-independent Hamiltonians (no_int_states^2 per k-point)
+  fftw_complex *m_lattice_U;
+  /// exp(i p_c.x) on the real-space grid for internal states with a nonzero momentum offset (nullptr otherwise)
+  std::array<fftw_complex *,no_int_states> m_frame_phase;
+  /// Kinetic exponentials m_full_step and m_half_step shifted by the momentum offset of each internal state (nullptr if not shifted)
+  std::array<fftw_complex *,no_int_states> m_frame_full_step;
+  std::array<fftw_complex *,no_int_states> m_frame_half_step;
+  /// r2c transform for the convolution of the density with U_k (on the zero-padded grid if requested, nullptr if no U_k)
+  T *m_conv;
+  /// U_k on the half spectrum of m_conv
+  double *m_conv_U;
+  /// Weight of each internal state in the convolved density
+  std::array<double,no_int_states> m_conv_weights;
+  /// Strides of the grid of m_conv, used to map the tiles of the fields into it
+  int64_t m_conv_stride[3];
+  /// Open time series of the observables, by file name (attribute obs_file)
+  std::map<std::string,std::unique_ptr<Output::Time_Series>> m_time_series;
+
+  /// Estimated work, output and memory of one sequence
+  struct sequence_cost
+  {
+    int64_t steps; ///< potential or internal steps
+    int64_t kinetic_steps; ///< half and full kinetic steps
+    int64_t ffts; ///< single transforms (forward or backward) of a field or of the convolution grid
+    int64_t output_frames;
+    uint64_t output_bytes;
+    uint64_t memory; ///< bytes allocated for the sequence in addition to the fields (per process)
+    double wall_time; ///< seconds without output, predicted by plan_sequence()
+  };
+
+  /// One sequence of m_params->m_sequence, validated and prepared by Compile_Sequences()
+  struct sequence_plan
+  {
+    size_t index; ///< Index in m_params->m_sequence
+    bool custom; ///< Not a built-in sequence, left to run_custom_sequence
+    StepFunction step_fct;
+    bool lattice; ///< momentum_lattice engine
+    bool frame; ///< Split-step engine in the co-moving frame of the plane-wave couplings
+    bool exact; ///< Position-independent linear Hamiltonian, each block is propagated exactly in k-space (Exact_Block)
+    bool position_dependent;
+    bool time_dependent;
+    bool nonlinear;
+    std::unique_ptr<mu::Parser> parser; ///< Hamiltonian of the sequence
+    double max_duration;
+    /// Blocks of steps between two outputs (number of steps, step width), the last one may be a rest without output
+    std::vector<std::pair<int,double>> blocks;
+    sequence_cost cost;
+  };
+
+  /// Kinetic tables of at most this many bytes are kept for all step widths of the plan
+  static const uint64_t KINETIC_CACHE_SIZE = uint64_t(256) << 20;
+
+  /// Prepared sequences, in the order of m_params->m_sequence
+  std::vector<sequence_plan> m_plan;
+  /// Kinetic exponentials (full step, half step) by step width, empty if they do not fit into KINETIC_CACHE_SIZE
+  std::map<double,std::pair<fftw_complex *,fftw_complex *>> m_kinetic_tables;
+  /// m_full_step and m_half_step as allocated by CRT_Base (they point into m_kinetic_tables while a cached step width is used)
+  fftw_complex *m_own_full_step;
+  fftw_complex *m_own_half_step;
+
+  void Compile_Sequences();
+  void Build_Parser( const sequence_item &, sequence_plan & );
+  void Estimate_Cost( const sequence_item &, sequence_plan & ) const;
+  uint64_t Base_Memory() const;
+  void Build_Kinetic_Tables();
+  void Free_Kinetic_Tables();
+  void Use_dt( const double );
+  void Prepare_Sequence( const sequence_plan &, StepFunction &, StepFunction &, StepFunction & );
+
   /// Define custom sequences
   virtual bool run_custom_sequence( const sequence_item & )=0;
 
@@ -91,6 +288,25 @@ CRT_Base_IF<T,dim,no_int_states>::CRT_Base_IF( ParameterHandler *params ) : CRT_
   this->m_map_stepfcts["freeprop"] = &Do_NL_Step_Wrapper;
   this->m_map_stepfcts["interact"] = &Numerical_Diagonalization_Wrapper;
 
+  m_lattice_U = nullptr;
+  for ( int c=0; c<no_int_states; c++ )
+    m_coupling_shift[c].fill(0);
+  m_frame_phase.fill(nullptr);
+  m_frame_full_step.fill(nullptr);
+  m_frame_half_step.fill(nullptr);
+  m_conv = nullptr;
+  m_conv_U = nullptr;
+  m_gpe = false;
+  m_static_potential = false;
+  m_global_phase.fill(0);
+  m_global_phase_pending = false;
+  m_sub_step_fct = nullptr;
+  m_sub_steps = 1;
+  m_magnus = false;
+  V_parser = nullptr;
+  m_own_full_step = this->m_full_step;
+  m_own_half_step = this->m_half_step;
+
   UpdateParams();
 }
 
@@ -98,6 +314,13 @@ CRT_Base_IF<T,dim,no_int_states>::CRT_Base_IF( ParameterHandler *params ) : CRT_
 template <class T, int dim, int no_int_states>
 CRT_Base_IF<T,dim,no_int_states>::~CRT_Base_IF()
 {
+  fftw_free( m_lattice_U );
+  Free_Plane_Wave_Frame();
+  Free_Convolution();
+  // CRT_Base frees its own tables
+  this->m_full_step = m_own_full_step;
+  this->m_half_step = m_own_half_step;
+  Free_Kinetic_Tables();
 }
 
 /** Set values to interferometer variables from xml (m_params)
@@ -142,6 +365,50 @@ void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization_Wrapper ( void
   self->Numerical_Diagonalization();
 }
 
+/** Wrapper function for Plane_Wave_Step()
+  * @param ptr Function pointer to be set to Plane_Wave_Step()
+  * @param seq Additional information about the sequence (for example file names if a file has to be read)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Plane_Wave_Step_Wrapper ( void *ptr, sequence_item &seq )
+{
+  CRT_Base_IF<T,dim,no_int_states> *self = static_cast<CRT_Base_IF<T,dim,no_int_states>*>(ptr);
+  self->Plane_Wave_Step();
+}
+
+/** Wrapper function for Do_FT_Step_Frame(false)
+  * @param ptr Function pointer to be set to Do_FT_Step_Frame()
+  * @param seq Additional information about the sequence (for example file names if a file has to be read)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Do_FT_Step_full_Frame_Wrapper ( void *ptr, sequence_item &seq )
+{
+  CRT_Base_IF<T,dim,no_int_states> *self = static_cast<CRT_Base_IF<T,dim,no_int_states>*>(ptr);
+  self->Do_FT_Step_Frame(false);
+}
+
+/** Wrapper function for Sub_Cycled_Step()
+  * @param ptr Function pointer to be set to Sub_Cycled_Step()
+  * @param seq Additional information about the sequence (for example file names if a file has to be read)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Sub_Cycled_Step_Wrapper ( void *ptr, sequence_item &seq )
+{
+  CRT_Base_IF<T,dim,no_int_states> *self = static_cast<CRT_Base_IF<T,dim,no_int_states>*>(ptr);
+  self->Sub_Cycled_Step(seq);
+}
+
+/** Wrapper function for Do_FT_Step_Frame(true)
+  * @param ptr Function pointer to be set to Do_FT_Step_Frame()
+  * @param seq Additional information about the sequence (for example file names if a file has to be read)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Do_FT_Step_half_Frame_Wrapper ( void *ptr, sequence_item &seq )
+{
+  CRT_Base_IF<T,dim,no_int_states> *self = static_cast<CRT_Base_IF<T,dim,no_int_states>*>(ptr);
+  self->Do_FT_Step_Frame(true);
+}
+
 /** Solves the potential part without any external fields but
   * gravity.
   */
@@ -150,7 +417,7 @@ void CRT_Base_IF<T,dim,no_int_states>::Do_NL_Step()
 {
   const double dt = -m_header.dt*this->Get_t_scale();
   this->t = this->Get_t()*this->Get_t_scale();
-  double re1, im1, tmp1, phi[no_int_states];
+  double phi[no_int_states][Fourier::cft_base<dim>::TILE_LENGTH];
 
   int nNum = this->V_parser->GetNumResults();
   vector<fftw_complex *> Psi;
@@ -158,373 +425,1995 @@ void CRT_Base_IF<T,dim,no_int_states>::Do_NL_Step()
   for ( int i=0; i<no_int_states; i++ )
     Psi.push_back(m_fields[i]->Getp2In());
 
-  if (this->nonlinear == true) //Calculate V(psi(r,t),r,t) at t for all r
+  // Nonlocal part U*n, evaluated before any component is changed
+  const double *V_conv = nullptr;
+  if ( m_conv != nullptr )
+  {
+    Compute_Convolution();
+    V_conv = m_conv->Getp2InReal();
+  }
+
+  if ( !m_static_potential && (this->position_dependent == true || this->nonlinear == true) ) //Calculate V(psi(r,t),r,t) or V(r,t) at t for all r
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ )
+    for ( int64_t it=0; it<this->m_fields[0]->Get_No_Tiles(); it++ )
     {
-        //vector<fftw_complex *> psi;
-        for ( int i=0; i<no_int_states; i++ )
+      const Fourier::grid_tile tile = this->m_fields[0]->Get_Tile(it);
+      for ( int d=0; d<dim-1; d++ )
+        this->x[d] = this->m_fields[0]->Get_x_Table(d)[tile.idx[d]];
+      const double *x_last = this->m_fields[0]->Get_x_Table(dim-1) + tile.idx[dim-1];
+
+      // V only depends on psi at the same point, so the phases of a tile can be collected first
+      for ( int m=0; m<tile.n; m++ )
+      {
+        if ( this->nonlinear == true )
         {
-          //psi.push_back(m_fields[i]->Getp2In());
-          this->psi_real_array[i] = Psi[i][l][0];
-          this->psi_imag_array[i] = Psi[i][l][1];
+          for ( int i=0; i<no_int_states; i++ )
+          {
+            this->psi_real_array[i] = Psi[i][tile.l0+m][0];
+            this->psi_imag_array[i] = Psi[i][tile.l0+m][1];
+          }
         }
-        this->x = this->m_fields[0]->Get_x(l);
+        this->x[dim-1] = x_last[m];
         double *V_ptr = this->V_parser->Eval(nNum);
         for ( int i=0; i<no_int_states; i++ )
         {
-        double V_real = *(V_ptr+(2*i));
-        phi[i] = V_real*dt;
+          double V_real = *(V_ptr+(2*i));
+          phi[i][m] = V_real*dt;
         }
-      
+      }
+
+      Add_Nonlinear_Phase( tile, dt, V_conv, phi );
+
       //Compute exponential: exp(V)*Psi
       for ( int i=0; i<no_int_states; i++ )
-      {
-        sincos( phi[i], &im1, &re1 );
-
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
-      }
+        Kernels::Multiply_Phase( Psi[i]+tile.l0, phi[i], tile.n );
     }
   }
-
-  if ( (this->position_dependent == true) and (this->nonlinear == false)) //Calculate V(r,t) at t for all r
+  else if ( m_static_potential || m_gpe || V_conv != nullptr ) //Calculate V(t) at t or the cached V(r), plus the GPE and nonlocal parts for all r
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ )
+    double V_t[no_int_states] = {};
+    if ( !m_static_potential )
     {
-        this->x = this->m_fields[0]->Get_x(l);
-        double *V_ptr = this->V_parser->Eval(nNum);
+      double *V_ptr = this->V_parser->Eval(nNum);
+      for ( int i=0; i<no_int_states; i++ )
+        V_t[i] = *(V_ptr+(2*i));
+    }
+
+    #pragma omp parallel
+    {
+      double phi_t[no_int_states][Fourier::cft_base<dim>::TILE_LENGTH];
+
+      #pragma omp for
+      for ( int64_t it=0; it<this->m_fields[0]->Get_No_Tiles(); it++ )
+      {
+        const Fourier::grid_tile tile = this->m_fields[0]->Get_Tile(it);
         for ( int i=0; i<no_int_states; i++ )
         {
-          double V_real = *(V_ptr+(2*i));
-          phi[i] = V_real*dt;
+          if ( m_static_potential )
+          {
+            const double *V = m_Potential[i].data() + tile.l0;
+            for ( int m=0; m<tile.n; m++ )
+              phi_t[i][m] = V[m]*dt;
+          }
+          else
+          {
+            for ( int m=0; m<tile.n; m++ )
+              phi_t[i][m] = V_t[i]*dt;
+          }
         }
-      
-      //Compute exponential: exp(V)*Psi
-      for ( int i=0; i<no_int_states; i++ )
-      {
-        sincos( phi[i], &im1, &re1 );
 
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+        Add_Nonlinear_Phase( tile, dt, V_conv, phi_t );
+
+        for ( int i=0; i<no_int_states; i++ )
+          Kernels::Multiply_Phase( Psi[i]+tile.l0, phi_t[i], tile.n );
       }
     }
   }
-
-  if ( (this->position_dependent == false) and (this->nonlinear == false)) //Calculate V(t) at t
+  else //Calculate V(t) at t, a uniform phase per component that is applied later by Apply_Global_Phases()
   {
     double *V_ptr = this->V_parser->Eval(nNum);
-    for ( int l=0; l<this->m_no_of_pts; l++ )
-    {    
-      for ( int i=0; i<no_int_states; i++ )
-      {
-        double V_real = *(V_ptr+(2*i));
-        phi[i] = V_real*dt;
-      }
-      
-      //Compute exponential: exp(V)*Psi
-      for ( int i=0; i<no_int_states; i++ )
-      {
-        sincos( phi[i], &im1, &re1 );
+    for ( int i=0; i<no_int_states; i++ )
+      m_global_phase[i] = fmod( m_global_phase[i] + *(V_ptr+(2*i))*dt, 2*M_PI );
+    m_global_phase_pending = true;
+  }
+}
+
+/** Multiplies each internal state by its accumulated uniform phase exp(i m_global_phase[c])
+  *
+  * A position-independent linear potential only changes the phase of each internal state by the same amount on
+  * all points, which commutes with the kinetic steps. Exact_Block() (freeprop with engine auto or exact) and
+  * Do_NL_Step() (engine split_step) therefore only add up the phases. run_sequence() applies them only before the
+  * fields are written, measured or passed to the custom function, and at the end of the sequence, i.e. before
+  * another sequence can couple the internal states.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Apply_Global_Phases()
+{
+  if ( !m_global_phase_pending ) return;
+
+  for ( int i=0; i<no_int_states; i++ )
+  {
+    if ( m_global_phase[i] == 0 ) continue;
+    double re1, im1;
+    sincos( m_global_phase[i], &im1, &re1 );
+    fftw_complex *Psi = m_fields[i]->Getp2In();
 
-        tmp1 = Psi[i][l][0];
-        Psi[i][l][0] = Psi[i][l][0]*re1 - Psi[i][l][1]*im1;
-        Psi[i][l][1] = Psi[i][l][1]*re1 + tmp1*im1;
+    #pragma omp parallel for
+    for ( int64_t it=0; it<this->m_fields[i]->Get_No_Tiles(); it++ )
+    {
+      const Fourier::grid_tile tile = this->m_fields[i]->Get_Tile(it);
+      Kernels::Multiply_Const( Psi+tile.l0, re1, im1, tile.n );
+    }
+  }
+  m_global_phase.fill(0);
+  m_global_phase_pending = false;
+}
+
+
+/** Adds the phases of the native GPE term \f$ \sum_j g_{ij} |\psi_j|^2 \f$ and of the nonlocal potential to the phases of a tile
+  *
+  * Both depend on the wavefunction at the start of the step, so this has to be called before any component of the tile is changed.
+  *
+  * @param tile Tile of the fields
+  * @param dt Time step (including the sign of the phase)
+  * @param V_conv Result of Compute_Convolution() or nullptr
+  * @param phi Phases of the internal states on the points of the tile
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Add_Nonlinear_Phase( const Fourier::grid_tile &tile, const double dt, const double *V_conv, double phi[][Fourier::cft_base<dim>::TILE_LENGTH] )
+{
+  if ( m_gpe )
+  {
+    double dens[no_int_states][Fourier::cft_base<dim>::TILE_LENGTH];
+    for ( int j=0; j<no_int_states; j++ )
+    {
+      const fftw_complex *Psi = m_fields[j]->Getp2In() + tile.l0;
+      #pragma omp simd
+      for ( int m=0; m<tile.n; m++ )
+        dens[j][m] = Psi[m][0]*Psi[m][0]+Psi[m][1]*Psi[m][1];
+    }
+    for ( int i=0; i<no_int_states; i++ )
+    {
+      for ( int j=0; j<no_int_states; j++ )
+      {
+        const double g = this->m_gs[no_int_states*i+j]*dt;
+        if ( g == 0 ) continue;
+        #pragma omp simd
+        for ( int m=0; m<tile.n; m++ )
+          phi[i][m] += g*dens[j][m];
       }
     }
   }
+
+  if ( V_conv != nullptr )
+  {
+    const double *V_tile = V_conv + Conv_Offset( tile );
+    for ( int i=0; i<no_int_states; i++ )
+      for ( int m=0; m<tile.n; m++ )
+        phi[i][m] += V_tile[m]*dt;
+  }
+}
+
+/** Reads the matrix m_gs of the native GPE term from the constants g_ij (i,j = 1 ... no_int_states) of the xml file
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Setup_GPE()
+{
+  for ( int i=0; i<no_int_states; i++ )
+    for ( int j=0; j<no_int_states; j++ )
+      this->m_gs[no_int_states*i+j] = m_params->Get_Constant( "g_" + std::to_string(i+1) + std::to_string(j+1) );
 }
 
+/** Evaluates the time independent and linear potential of a sequence once on the grid (m_Potential)
+  *
+  * Do_NL_Step() then only reads the cached values instead of calling the parser at each point and step.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Cache_Static_Potential()
+{
+  this->Init_Potential();
+  int nNum = this->V_parser->GetNumResults();
+
+  for ( int64_t it=0; it<this->m_fields[0]->Get_No_Tiles(); it++ )
+  {
+    const Fourier::grid_tile tile = this->m_fields[0]->Get_Tile(it);
+    for ( int d=0; d<dim-1; d++ )
+      this->x[d] = this->m_fields[0]->Get_x_Table(d)[tile.idx[d]];
+    const double *x_last = this->m_fields[0]->Get_x_Table(dim-1) + tile.idx[dim-1];
+
+    for ( int m=0; m<tile.n; m++ )
+    {
+      this->x[dim-1] = x_last[m];
+      double *V_ptr = this->V_parser->Eval(nNum);
+      for ( int i=0; i<no_int_states; i++ )
+        m_Potential[i][tile.l0+m] = *(V_ptr+(2*i));
+    }
+  }
+}
 
 /** Solves the potential part in the presence of light fields with a numerical method
   *
   * In this function \f$ \exp(V)\Psi \f$ is calculated. The matrix exponential is computed
-  * with the help of a numerical diagonalisation which uses the gsl library
+  * with the help of a numerical diagonalisation which uses the gsl library. If the Hamiltonian depends neither on
+  * the position nor on psi, the exponential is computed once and applied to all points by Apply_Uniform_Propagator().
+  * With integrator="magnus4" a linear Hamiltonian is evaluated at the two Gauss nodes of the step and two exponentials of
+  * their combinations (Magnus_Weights()) are applied one after the other.
   */
 template <class T, int dim, int no_int_states>
 void CRT_Base_IF<T,dim,no_int_states>::Numerical_Diagonalization()
 {
+  if ( !this->position_dependent && !this->nonlinear )
+  {
+    gsl_complex U[no_int_states*no_int_states];
+    Uniform_Propagator( m_header.t, m_header.dt, false, U );
+    Apply_Uniform_Propagator( U );
+    return;
+  }
+
   this->t = this->Get_t()*this->Get_t_scale();
   int nNum = this->V_parser->GetNumResults();
   double *V_ptr = this->V_parser->Eval(nNum); // initializes nNum
-  const long long int N_V_eval = this->m_no_of_pts*no_int_states*nNum ;
-  double V_eval[N_V_eval];
+  const int no_evals = ( m_magnus && !this->nonlinear ) ? 2 : 1;
+  const int64_t N_V = int64_t(this->m_no_of_pts)*nNum;
+  std::vector<double> V_eval( no_evals*N_V );
   vector<fftw_complex *> Psi;
   for ( int i=0; i<no_int_states; i++ )
     Psi.push_back(m_fields[i]->Getp2In());
 
   if (this->nonlinear == true) //Calculate V(psi(r,t),r,t) at t for all r
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ ) //TODO parallelizing this would be good
+    for ( int64_t it=0; it<this->m_fields[0]->Get_No_Tiles(); it++ ) //TODO parallelizing this would be good
     {
-      //vector<fftw_complex *> psi;
-      for ( int i=0; i<no_int_states; i++ )
-      {
-        this->psi_real_array[i] = Psi[i][l][0];
-        this->psi_imag_array[i] = Psi[i][l][1];
-      }
-      this->x = this->m_fields[0]->Get_x(l);
-      V_ptr = this->V_parser->Eval(nNum);
-      for (int j=0; j<nNum; j++)
+      const Fourier::grid_tile tile = this->m_fields[0]->Get_Tile(it);
+      for ( int d=0; d<dim-1; d++ )
+        this->x[d] = this->m_fields[0]->Get_x_Table(d)[tile.idx[d]];
+      const double *x_last = this->m_fields[0]->Get_x_Table(dim-1) + tile.idx[dim-1];
+
+      for ( int64_t l=tile.l0; l<tile.l0+tile.n; l++ )
       {
-        V_eval[l*nNum+j] = *(V_ptr+(j));
+        //vector<fftw_complex *> psi;
+        for ( int i=0; i<no_int_states; i++ )
+        {
+          this->psi_real_array[i] = Psi[i][l][0];
+          this->psi_imag_array[i] = Psi[i][l][1];
+        }
+        this->x[dim-1] = x_last[l-tile.l0];
+        V_ptr = this->V_parser->Eval(nNum);
+        for (int j=0; j<nNum; j++)
+        {
+          V_eval[l*nNum+j] = *(V_ptr+(j));
+        }
       }
     }
   }
-  if ( (this->position_dependent == true) and (this->nonlinear == false)) //Calculate V(r,t) at t for all r
+  if ( (this->position_dependent == true) and (this->nonlinear == false)) //Calculate V(r,t) at t (or at the Gauss nodes) for all r
   {
-    for ( int l=0; l<this->m_no_of_pts; l++ ) //TODO parallelizing this would be good
+    for ( int e=0; e<no_evals; e++ )
     {
-      this->x = this->m_fields[0]->Get_x(l);
-      V_ptr = this->V_parser->Eval(nNum);
-      for (int j=0; j<nNum; j++)
+      if ( no_evals == 2 )
+        this->t = ( this->Get_t() + (2*e-1)*MAGNUS_NODE*m_header.dt )*this->Get_t_scale();
+      double *V_e = V_eval.data() + e*N_V;
+
+      for ( int64_t it=0; it<this->m_fields[0]->Get_No_Tiles(); it++ ) //TODO parallelizing this would be good
       {
-        V_eval[l*nNum+j] = *(V_ptr+(j));
+        const Fourier::grid_tile tile = this->m_fields[0]->Get_Tile(it);
+        for ( int d=0; d<dim-1; d++ )
+          this->x[d] = this->m_fields[0]->Get_x_Table(d)[tile.idx[d]];
+        const double *x_last = this->m_fields[0]->Get_x_Table(dim-1) + tile.idx[dim-1];
+
+        for ( int64_t l=tile.l0; l<tile.l0+tile.n; l++ )
+        {
+          this->x[dim-1] = x_last[l-tile.l0];
+          V_ptr = this->V_parser->Eval(nNum);
+          for (int j=0; j<nNum; j++)
+          {
+            V_e[l*nNum+j] = *(V_ptr+(j));
+          }
+        }
       }
     }
   }
-  if ( (this->position_dependent == false) and (this->nonlinear == false)) //Calculate V(t) at t
+  if ( no_evals == 2 ) // V(t_1), V(t_2) -> exponents of the first and of the second factor
   {
-    V_ptr = this->V_parser->Eval(nNum);
-    for ( int l=0; l<this->m_no_of_pts; l++ ) //TODO parallelizing this would be good
+    double w[2][2];
+    Magnus_Weights( w );
+    #pragma omp parallel for
+    for ( int64_t l=0; l<N_V; l++ )
     {
-      for (int j=0; j<nNum; j++)
-      {
-        V_eval[l*nNum+j] = *(V_ptr+(j));
-      }
+      const double V_1 = V_eval[l];
+      const double V_2 = V_eval[N_V+l];
+      V_eval[l] = w[0][0]*V_1 + w[0][1]*V_2;
+      V_eval[N_V+l] = w[1][0]*V_1 + w[1][1]*V_2;
     }
   }
-  #pragma omp parallel
+  for ( int e=0; e<no_evals; e++ )
   {
-	  double re1, im1;
-    const double dt = -m_header.dt*this->Get_t_scale();
-
-    //vector<fftw_complex *> Psi;
-    //for ( int i=0; i<no_int_states; i++ )
-    //  Psi.push_back(m_fields[i]->Getp2In());
-
-    gsl_matrix_complex *A = gsl_matrix_complex_calloc(no_int_states,no_int_states);
-    gsl_matrix_complex *B = gsl_matrix_complex_calloc(no_int_states,no_int_states);
-    gsl_eigen_hermv_workspace *w = gsl_eigen_hermv_alloc(no_int_states);
-    gsl_vector *eval = gsl_vector_alloc(no_int_states);
-    gsl_vector_complex *Psi_1 = gsl_vector_complex_alloc(no_int_states);
-    gsl_vector_complex *Psi_2 = gsl_vector_complex_alloc(no_int_states);
-    gsl_matrix_complex *evec = gsl_matrix_complex_alloc(no_int_states,no_int_states);
-
-    #pragma omp for
-    for ( int l=0; l<this->m_no_of_pts; l++ )
+    #pragma omp parallel
     {
-      gsl_matrix_complex_set_zero(A);
-      gsl_matrix_complex_set_zero(B);
-
-      int m = 0;
-      for ( int i=0; i<no_int_states; i++ )
+  	  double re1, im1;
+      const double dt = -m_header.dt*this->Get_t_scale();
+      const double *V_e = V_eval.data() + e*N_V;
+
+      //vector<fftw_complex *> Psi;
+      //for ( int i=0; i<no_int_states; i++ )
+      //  Psi.push_back(m_fields[i]->Getp2In());
+
+      gsl_matrix_complex *A = gsl_matrix_complex_calloc(no_int_states,no_int_states);
+      gsl_matrix_complex *B = gsl_matrix_complex_calloc(no_int_states,no_int_states);
+      gsl_eigen_hermv_workspace *w = gsl_eigen_hermv_alloc(no_int_states);
+      gsl_vector *eval = gsl_vector_alloc(no_int_states);
+      gsl_vector_complex *Psi_1 = gsl_vector_complex_alloc(no_int_states);
+      gsl_vector_complex *Psi_2 = gsl_vector_complex_alloc(no_int_states);
+      gsl_matrix_complex *evec = gsl_matrix_complex_alloc(no_int_states,no_int_states);
+
+      #pragma omp for
+      for ( int l=0; l<this->m_no_of_pts; l++ )
       {
-        for ( int j=i; j<no_int_states; j++ )
+        gsl_matrix_complex_set_zero(A);
+        gsl_matrix_complex_set_zero(B);
+
+        int m = 0;
+        for ( int i=0; i<no_int_states; i++ )
         {
-          double V_real = V_eval[l*nNum+2*m];
-          double V_imag = V_eval[l*nNum+2*m+1];
-          if (i != j) //nondiagonal elements
+          for ( int j=i; j<no_int_states; j++ )
           {
-            gsl_matrix_complex_set(A,i,j, {V_real,V_imag});
-            gsl_matrix_complex_set(A,j,i, {V_real,-V_imag});
-          }
-          else
-          { //diagonal elements
-            gsl_matrix_complex_set(A,i,i, {V_real,0});
+            double V_real = V_e[l*nNum+2*m];
+            double V_imag = V_e[l*nNum+2*m+1];
+            if (i != j) //nondiagonal elements
+            {
+              gsl_matrix_complex_set(A,i,j, {V_real,V_imag});
+              gsl_matrix_complex_set(A,j,i, {V_real,-V_imag});
+            }
+            else
+            { //diagonal elements
+              gsl_matrix_complex_set(A,i,i, {V_real,0});
+            }
+            m += 1;
           }
-          m += 1;
         }
-      }
 
 
 
-      //Compute Eigenvalues + Eigenvector
-      gsl_eigen_hermv(A,eval,evec,w);
+        //Compute Eigenvalues + Eigenvector
+        gsl_eigen_hermv(A,eval,evec,w);
 
-      // exp(Eigenvalues)
-      for ( int i=0; i<no_int_states; i++ )
-      {
-        sincos( dt*gsl_vector_get(eval,i), &im1, &re1 );
-        gsl_matrix_complex_set(B,i,i, {re1,im1});
-      }
+        // exp(Eigenvalues)
+        for ( int i=0; i<no_int_states; i++ )
+        {
+          sincos( dt*gsl_vector_get(eval,i), &im1, &re1 );
+          gsl_matrix_complex_set(B,i,i, {re1,im1});
+        }
 
-      // H_new = Eigenvector * exp(Eigenvalues) * conjugate(Eigenvector)
-      gsl_blas_zgemm(CblasNoTrans,CblasConjTrans,GSL_COMPLEX_ONE,B,evec,GSL_COMPLEX_ZERO,A);
-      gsl_blas_zgemm(CblasNoTrans,CblasNoTrans,GSL_COMPLEX_ONE,evec,A,GSL_COMPLEX_ZERO,B);
+        // H_new = Eigenvector * exp(Eigenvalues) * conjugate(Eigenvector)
+        gsl_blas_zgemm(CblasNoTrans,CblasConjTrans,GSL_COMPLEX_ONE,B,evec,GSL_COMPLEX_ZERO,A);
+        gsl_blas_zgemm(CblasNoTrans,CblasNoTrans,GSL_COMPLEX_ONE,evec,A,GSL_COMPLEX_ZERO,B);
 
-      for ( int i=0; i<no_int_states; i++)
-      {
-        gsl_vector_complex_set(Psi_1,i, {Psi[i][l][0],Psi[i][l][1]});
-      }
+        for ( int i=0; i<no_int_states; i++)
+        {
+          gsl_vector_complex_set(Psi_1,i, {Psi[i][l][0],Psi[i][l][1]});
+        }
 
-      // H_new * Psi
-      gsl_blas_zgemv(CblasNoTrans,GSL_COMPLEX_ONE,B,Psi_1,GSL_COMPLEX_ZERO,Psi_2);
+        // H_new * Psi
+        gsl_blas_zgemv(CblasNoTrans,GSL_COMPLEX_ONE,B,Psi_1,GSL_COMPLEX_ZERO,Psi_2);
 
-      for ( int i=0; i<no_int_states; i++)
-      {
-        Psi[i][l][0] = gsl_vector_complex_get(Psi_2,i).dat[0];
-        Psi[i][l][1] = gsl_vector_complex_get(Psi_2,i).dat[1];
+        for ( int i=0; i<no_int_states; i++)
+        {
+          Psi[i][l][0] = gsl_vector_complex_get(Psi_2,i).dat[0];
+          Psi[i][l][1] = gsl_vector_complex_get(Psi_2,i).dat[1];
+        }
       }
+      gsl_matrix_complex_free(A);
+      gsl_matrix_complex_free(B);
+      gsl_eigen_hermv_free(w);
+      gsl_vector_free(eval);
+      gsl_vector_complex_free(Psi_1);
+      gsl_vector_complex_free(Psi_2);
+      gsl_matrix_complex_free(evec);
     }
-    gsl_matrix_complex_free(A);
-    gsl_matrix_complex_free(B);
-    gsl_eigen_hermv_free(w);
-    gsl_vector_free(eval);
-    gsl_vector_complex_free(Psi_1);
-    gsl_vector_complex_free(Psi_2);
-    gsl_matrix_complex_free(evec);
   }
 }
 
-/** Run all the sequences defined in the xml file
+/** Read the plane-wave coupling of a sequence (attributes coupling_k and coupling_orders)
   *
-  * For furher information about the sequences see sequence_item
+  * Internal state c is assigned the momentum offset \f$ p_c = n_c \vec{K} \f$. The Hamiltonian has to be of the form
+  * \f$ V_{ij}(\vec{r},t) = A_{ij}(t) \exp(i(p_i-p_j)\cdot\vec{r}) \f$, i.e. every coupling is a plane wave of the
+  * lattice vector and the diagonal is position-independent. Then state (c, k+p_c) only couples within the family
+  * of a base momentum k. The offsets must be multiples of the k-space grid spacing, so that they are plain index
+  * shifts on the FFT grid. V_parser must already be set up for the sequence.
+  *
+  * @param seq Sequence with the coupling definition
   */
 template <class T, int dim, int no_int_states>
-void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
+void CRT_Base_IF<T,dim,no_int_states>::Setup_Plane_Wave_Coupling( const sequence_item &seq )
 {
-  if ( m_fields.size() != no_int_states )
+  if ( seq.coupling_k.size() != dim || seq.coupling_orders.size() != no_int_states )
+    throw std::string("Error in " + std::string(__func__) + ": sequence " + seq.name + " needs coupling_k with " + std::to_string(dim) + " entries and coupling_orders with one entry per internal state\n");
+  if ( this->nonlinear )
+    throw std::string("Error in " + std::string(__func__) + ": plane-wave couplings of sequence " + seq.name + " must not depend on psi\n");
+
+  mu::Parser mup;
+  m_params->Setup_muParser( mup );
+  mup.DefineConst("pi", (double)M_PI);
+  mup.DefineConst("e", (double)M_E);
+
+  CPoint<dim> K;
+  for ( int i=0; i<dim; i++ )
   {
-    std::cerr << "Critical Error: m_fields.size() != no_int_states\n";
-    exit(EXIT_FAILURE);
+    mup.SetExpr( seq.coupling_k[i] );
+    K[i] = mup.Eval();
   }
 
-  StepFunction step_fct=nullptr;
-  StepFunction half_step_fct=nullptr;
-  StepFunction full_step_fct=nullptr;
-  char filename[1024];
+  const double dk[3] = { this->Get_dkx(), this->Get_dky(), this->Get_dkz() };
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    for ( int i=0; i<dim; i++ )
+    {
+      m_coupling_p[c][i] = seq.coupling_orders[c]*K[i];
+      const double s = m_coupling_p[c][i]/dk[i];
+      m_coupling_shift[c][i] = int(lround(s));
+      if ( fabs(s-m_coupling_shift[c][i]) > 1e-6 )
+        throw std::string("Error in " + std::string(__func__) + ": coupling_k of sequence " + seq.name + " is not commensurate with the k-space grid\n");
+    }
+  }
 
-  std::cout << "FYI: Found " << m_params->m_sequence.size() << " sequences." << std::endl;
+  // Check V_ij(x) = V_ij(0)*exp(i(p_i-p_j)x) on a few grid points
+  int nNum;
+  this->t = this->Get_t()*this->Get_t_scale();
+  this->x = 0;
+  double *V_ptr = this->V_parser->Eval(nNum);
+  std::vector<double> A( V_ptr, V_ptr+nNum );
 
+  double norm = 1e-300;
+  for ( auto v : A ) norm = std::max( norm, fabs(v) );
 
-  try
+  const int64_t probes[3] = { 1, m_no_of_pts/3, m_no_of_pts-1 };
+  for ( auto l : probes )
   {
-    half_step_fct = this->m_map_stepfcts.at("half_step");
-    full_step_fct = this->m_map_stepfcts.at("full_step");
-  }
-  catch (const std::out_of_range &oor)
-  {
-    std::cerr << "Critical Error: Invalid fct ptr to ft_half_step or ft_full_step ()" << oor.what() << ")\n";
-    exit(EXIT_FAILURE);
+    this->x = this->m_fields[0]->Get_x(l);
+    V_ptr = this->V_parser->Eval(nNum);
+
+    int m = 0;
+    for ( int i=0; i<no_int_states; i++ )
+    {
+      for ( int j=i; j<no_int_states; j++ )
+      {
+        CPoint<dim> dp = m_coupling_p[i];
+        dp -= m_coupling_p[j];
+        double re, im;
+        sincos( dp*this->x, &im, &re );
+        const double err_re = V_ptr[2*m]   - (A[2*m]*re - A[2*m+1]*im);
+        const double err_im = V_ptr[2*m+1] - (A[2*m]*im + A[2*m+1]*re);
+        if ( i == j ) // only the real part of the diagonal is used
+        {
+          if ( fabs(err_re) > 1e-8*norm )
+            throw std::string("Error in " + std::string(__func__) + ": V_" + std::to_string(i+1) + std::to_string(j+1) + " of sequence " + seq.name + " must not depend on the position\n");
+        }
+        else if ( sqrt(err_re*err_re+err_im*err_im) > 1e-8*norm )
+        {
+          throw std::string("Error in " + std::string(__func__) + ": V_" + std::to_string(i+1) + std::to_string(j+1) + " of sequence " + seq.name + " is not a plane wave of coupling_k and coupling_orders\n");
+        }
+        m++;
+      }
+    }
   }
+  this->x = 0;
+}
 
-  int seq_counter=1;
+/** Shift a tile in k-space (FFTW ordering) by the momentum offset of an internal state
+  *
+  * @param tile Tile of the grid, see Fourier::cft_base::Get_Tile()
+  * @param comp Internal state
+  * @param sidx Array indices (i,j,k) of the momentum k+p_comp of the first point of the tile
+  * @returns Linear index of the first point of the shifted row. Point m of the tile is mapped to the linear
+  *          index retval + (sidx[dim-1]+m) modulo the number of points along the last axis.
+  */
+template <class T, int dim, int no_int_states>
+int64_t CRT_Base_IF<T,dim,no_int_states>::Shift_Tile( const Fourier::grid_tile &tile, const int comp, int sidx[3] )
+{
+  const int64_t n[3] = { m_header.nDimX, m_header.nDimY, m_header.nDimZ };
 
-  for ( auto seq : m_params->m_sequence )
+  int64_t retval = 0;
+  for ( int i=0; i<dim; i++ )
   {
-    if ( run_custom_sequence(seq) )
-    {
-      seq_counter++;
-      continue;
-    }
+    sidx[i] = int((tile.idx[i] + m_coupling_shift[comp][i]) % n[i]);
+    if ( sidx[i] < 0 ) sidx[i] += n[i];
+    if ( i < dim-1 ) retval = retval*n[i] + sidx[i];
+  }
+  return retval*n[dim-1];
+}
 
-  
-    double max_duration = 0;
-    for ( int i = 0; i < seq.duration.size(); i++)
-      if (seq.duration[i] > max_duration )
-        max_duration = seq.duration[i];
+/** Propagates a full time step dt in the momentum-lattice basis
+  *
+  * The wavefunction has to be in k-space. For every base momentum k the family of states (c, k+p_c) is
+  * propagated with the exact exponential of the kinetic energy plus the plane-wave coupling,
+  * \f$ \exp(-i \Delta t (\alpha (k+p_c)^2 \delta_{cc'} + A_{cc'}(t))) \f$, evaluated at the midpoint of the step.
+  * No Fourier transforms are needed in between. For time-independent Hamiltonians the propagators are computed once
+  * per sequence and cached in m_lattice_U.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Momentum_Lattice_Step()
+{
+  const int N = no_int_states;
+  const bool cached = (m_lattice_U != nullptr) && !this->time_dependent;
 
-    int subN = int(max_duration / seq.dt);
-    int Nk = seq.Nk;
-    int Na = subN / seq.Nk;
+  std::vector<double> A;
+  if ( !cached )
+  {
+    int nNum;
+    this->t = (this->Get_t()+0.5*m_header.dt)*this->Get_t_scale();
+    this->x = 0;
+    double *V_ptr = this->V_parser->Eval(nNum);
+    A.assign( V_ptr, V_ptr+nNum );
 
-    /* Definitions for the Hamiltonian parser */
-    this->V_parser = new mu::Parser; // Parser in heap
-    /** Read in Hamiltonian strings from XML */
-    std::string V_expression = "";
-    V_expression += seq.V_real[0];
-    V_expression += ",";
-    V_expression += seq.V_imag[0];
-    for (int i = 1; i<seq.V_real.size(); i++)
+    // The k-space array carries the phase exp(ik.x_0) of the grid origin x_0,
+    // so the coupling between shifted indices picks up exp(i(p_i-p_j).x_0)
+    CPoint<dim> x0 = m_fields[0]->Get_x(0);
+    int m = 0;
+    for ( int i=0; i<N; i++ )
     {
-      V_expression += ",";
-      V_expression += seq.V_real[i];
-      V_expression += ",";
-      V_expression += seq.V_imag[i];
+      for ( int j=i; j<N; j++ )
+      {
+        CPoint<dim> dp = m_coupling_p[i];
+        dp -= m_coupling_p[j];
+        double re, im, tmp;
+        sincos( dp*x0, &im, &re );
+        tmp = A[2*m];
+        A[2*m] = tmp*re - A[2*m+1]*im;
+        A[2*m+1] = tmp*im + A[2*m+1]*re;
+        m++;
+      }
     }
 
+    if ( m_lattice_U == nullptr && !this->time_dependent )
+      m_lattice_U = fftw_alloc_complex( int64_t(m_no_of_pts)*N*N );
+  }
 
-    /* Set Hamiltonian to evaluate dependencies*/
-    this->V_parser->SetExpr(V_expression);
-    // Get the map with the used variables
-    const std::map<std::__cxx11::basic_string<char>, double*> variables =  this->V_parser->GetUsedVar();
-    // Get the number of variables 
-    std::map<std::__cxx11::basic_string<char>, double*>::const_iterator item = variables.begin();
-    // Query the variables
-    position_dependent = false;
-    time_dependent = false;
-    nonlinear = false;
-
-    for (; item!=variables.end(); ++item)
-    {
-      if ((item->first == "x" ) or (item->first == "y" ) or (item->first == "z" ))
-      {
-        position_dependent = true;
-        //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
-      }
-      if (item->first == "t")
+  vector<fftw_complex *> Psi;
+  for ( int i=0; i<no_int_states; i++ )
+    Psi.push_back(m_fields[i]->Getp2In());
+
+  const double *k_table[dim];
+  double alpha[dim];
+  for ( int d=0; d<dim; d++ )
+  {
+    k_table[d] = m_fields[0]->Get_k_Table(d);
+    alpha[d] = this->m_alpha[d];
+  }
+  const int64_t n[3] = { m_header.nDimX, m_header.nDimY, m_header.nDimZ };
+  const int n_last = int(n[dim-1]);
+
+  #pragma omp parallel
+  {
+    const double dt = m_header.dt;
+    const double dt_V = m_header.dt*this->Get_t_scale();
+    int64_t idx[no_int_states];
+    double ekin[no_int_states];
+    gsl_complex U[no_int_states*no_int_states];
+    gsl_complex Psi_1[no_int_states];
+
+    gsl_matrix_complex *H = gsl_matrix_complex_calloc(N,N);
+    Hermitian_Exponential<no_int_states> expm;
+
+    #pragma omp for
+    for ( int64_t it=0; it<m_fields[0]->Get_No_Tiles(); it++ )
+    {
+      const Fourier::grid_tile tile = m_fields[0]->Get_Tile(it);
+
+      // Start of the shifted rows and kinetic energy along the outer axes of each state
+      int64_t row0[no_int_states];
+      int k0[no_int_states];
+      double e_outer[no_int_states];
+      for ( int c=0; c<N; c++ )
+      {
+        int sidx[3];
+        row0[c] = Shift_Tile( tile, c, sidx );
+        k0[c] = sidx[dim-1];
+        e_outer[c] = 0;
+        for ( int d=0; d<dim-1; d++ )
+          e_outer[c] += (k_table[d][sidx[d]]*alpha[d])*k_table[d][sidx[d]];
+      }
+
+      for ( int64_t l=tile.l0; l<tile.l0+tile.n; l++ )
+      {
+        for ( int c=0; c<N; c++ )
+        {
+          int kk = k0[c] + int(l-tile.l0);
+          if ( kk >= n_last ) kk -= n_last;
+          idx[c] = row0[c] + kk;
+          ekin[c] = e_outer[c] + (k_table[dim-1][kk]*alpha[dim-1])*k_table[dim-1][kk];
+        }
+
+        if ( cached )
+        {
+          for ( int i=0; i<N*N; i++ )
+            U[i] = { m_lattice_U[int64_t(l)*N*N+i][0], m_lattice_U[int64_t(l)*N*N+i][1] };
+        }
+        else
+        {
+          gsl_matrix_complex_set_zero(H);
+          int m = 0;
+          for ( int i=0; i<N; i++ )
+          {
+            for ( int j=i; j<N; j++ )
+            {
+              if ( i != j )
+              {
+                gsl_matrix_complex_set(H,i,j, {dt_V*A[2*m],dt_V*A[2*m+1]});
+                gsl_matrix_complex_set(H,j,i, {dt_V*A[2*m],-dt_V*A[2*m+1]});
+              }
+              else
+              {
+                gsl_matrix_complex_set(H,i,i, {dt*ekin[i]+dt_V*A[2*m],0});
+              }
+              m++;
+            }
+          }
+
+          expm.Compute( H, U );
+
+          if ( m_lattice_U != nullptr )
+          {
+            for ( int i=0; i<N*N; i++ )
+            {
+              m_lattice_U[int64_t(l)*N*N+i][0] = GSL_REAL(U[i]);
+              m_lattice_U[int64_t(l)*N*N+i][1] = GSL_IMAG(U[i]);
+            }
+          }
+        }
+
+        for ( int c=0; c<N; c++ )
+          Psi_1[c] = { Psi[c][idx[c]][0], Psi[c][idx[c]][1] };
+
+        for ( int i=0; i<N; i++ )
+        {
+          double sum_re = 0, sum_im = 0;
+          for ( int j=0; j<N; j++ )
+          {
+            sum_re += GSL_REAL(U[i*N+j])*GSL_REAL(Psi_1[j]) - GSL_IMAG(U[i*N+j])*GSL_IMAG(Psi_1[j]);
+            sum_im += GSL_REAL(U[i*N+j])*GSL_IMAG(Psi_1[j]) + GSL_IMAG(U[i*N+j])*GSL_REAL(Psi_1[j]);
+          }
+          Psi[i][idx[i]][0] = sum_re;
+          Psi[i][idx[i]][1] = sum_im;
+        }
+      }
+    }
+    gsl_matrix_complex_free(H);
+  }
+
+  m_header.t += m_header.dt;
+}
+
+/** Allocate and fill the tables of the co-moving frame of the plane-wave couplings
+  *
+  * In the frame \f$ \tilde\psi_c = \exp(-i p_c \cdot \vec{r}) \psi_c \f$ the couplings
+  * \f$ A_{ij}(t) \exp(i(p_i-p_j)\cdot\vec{r}) \f$ do not depend on the position, while the kinetic energy of state c
+  * becomes \f$ \alpha (k+p_c)^2 \f$. Since p_c is a multiple of the k-space grid spacing the latter is m_full_step
+  * (m_half_step) read at the shifted index. Setup_Plane_Wave_Coupling() and Set_dt() must have been called before.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Setup_Plane_Wave_Frame()
+{
+  Free_Plane_Wave_Frame();
+
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    bool shifted = false;
+    for ( int i=0; i<dim; i++ )
+      shifted = shifted || (m_coupling_shift[c][i] != 0);
+    if ( !shifted ) continue;
+
+    m_frame_phase[c] = fftw_alloc_complex( m_no_of_pts );
+    m_frame_full_step[c] = fftw_alloc_complex( m_no_of_pts );
+    m_frame_half_step[c] = fftw_alloc_complex( m_no_of_pts );
+
+    fftw_complex *phase = m_frame_phase[c];
+    fftw_complex *full = m_frame_full_step[c];
+    fftw_complex *half = m_frame_half_step[c];
+
+    const int64_t n[3] = { m_header.nDimX, m_header.nDimY, m_header.nDimZ };
+    const int n_last = int(n[dim-1]);
+    CPoint<dim> p = m_coupling_p[c];
+    const double dx[3] = { m_header.dx, m_header.dy, m_header.dz };
+    const double dphi = p[dim-1]*dx[dim-1];
+
+    #pragma omp parallel for
+    for ( int64_t it=0; it<m_fields[0]->Get_No_Tiles(); it++ )
+    {
+      const Fourier::grid_tile tile = m_fields[0]->Get_Tile(it);
+
+      double px_outer = 0;
+      for ( int d=0; d<dim-1; d++ )
+        px_outer += p[d]*m_fields[0]->Get_x_Table(d)[tile.idx[d]];
+      const double *x_last = m_fields[0]->Get_x_Table(dim-1) + tile.idx[dim-1];
+
+      Kernels::Exp_Linear_Phase( px_outer+p[dim-1]*x_last[0], dphi, phase+tile.l0, tile.n );
+
+      int sidx[3];
+      const int64_t row0 = Shift_Tile( tile, c, sidx );
+
+      for ( int m=0; m<tile.n; m++ )
+      {
+        const int64_t l = tile.l0+m;
+        int kk = sidx[dim-1]+m;
+        if ( kk >= n_last ) kk -= n_last;
+        const int64_t s = row0+kk;
+        full[l][0] = this->m_full_step[s][0];
+        full[l][1] = this->m_full_step[s][1];
+        half[l][0] = this->m_half_step[s][0];
+        half[l][1] = this->m_half_step[s][1];
+      }
+    }
+  }
+}
+
+/// Free the tables of the co-moving frame
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Free_Plane_Wave_Frame()
+{
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    fftw_free( m_frame_phase[c] );
+    fftw_free( m_frame_full_step[c] );
+    fftw_free( m_frame_half_step[c] );
+    m_frame_phase[c] = nullptr;
+    m_frame_full_step[c] = nullptr;
+    m_frame_half_step[c] = nullptr;
+  }
+}
+
+/** Prepares the convolution of the density with the nonlocal interaction kernel U_k of a sequence
+  *
+  * U_k is the Fourier transform \f$ \tilde{U}(\vec{k}) = \int U(\vec{r}) e^{-i\vec{k}\cdot\vec{r}} d\vec{r} \f$ of the
+  * kernel as a function of kx, ky and kz. It is evaluated once on the half spectrum of a r2c transform. Points where
+  * U_k is not finite (e.g. the dipolar kernel at k=0) are set to zero. With U_padding the transform lives on a grid of
+  * twice the size in each direction, so that the periodic images of U do not interact with the density.
+  *
+  * @param seq Sequence with U_k, U_weights and U_padding
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Setup_Convolution( const sequence_item &seq )
+{
+  if ( seq.U_weights.size() != no_int_states )
+    throw std::string("Error in " + std::string(__func__) + ": sequence " + seq.name + " needs U_weights with one entry per internal state\n");
+
+  generic_header header = m_header;
+  if ( seq.U_padding )
+  {
+    header.nDimX *= 2;
+    header.xMax = header.xMin + 2*(header.xMax-header.xMin);
+    header.dkx *= 0.5;
+    if ( dim > 1 )
+    {
+      header.nDimY *= 2;
+      header.yMax = header.yMin + 2*(header.yMax-header.yMin);
+      header.dky *= 0.5;
+    }
+    if ( dim > 2 )
+    {
+      header.nDimZ *= 2;
+      header.zMax = header.zMin + 2*(header.zMax-header.zMin);
+      header.dkz *= 0.5;
+    }
+  }
+
+  m_conv = new T( header, false, false, Fourier::TYPE::REAL );
+  m_conv_U = fftw_alloc_real( m_conv->Get_Dim_FS() );
+  for ( int i=0; i<no_int_states; i++ )
+    m_conv_weights[i] = seq.U_weights[i];
+
+  const int64_t n[3] = { m_conv->Get_Dim_X(), m_conv->Get_Dim_Y(), m_conv->Get_Dim_Z() };
+  m_conv_stride[dim-1] = 1;
+  for ( int d=dim-2; d>=0; d-- )
+    m_conv_stride[d] = m_conv_stride[d+1]*n[d+1];
+
+  mu::Parser mup;
+  m_params->Setup_muParser( mup );
+  mup.DefineConst("pi", (double)M_PI);
+  mup.DefineConst("e", (double)M_E);
+
+  double k[3] = { 0, 0, 0 };
+  mup.DefineVar("kx", &k[0]);
+  if ( dim > 1 ) mup.DefineVar("ky", &k[1]);
+  if ( dim > 2 ) mup.DefineVar("kz", &k[2]);
+  mup.SetExpr( seq.U_k );
+
+  for ( int64_t it=0; it<m_conv->Get_No_Tiles_FS(); it++ )
+  {
+    const Fourier::grid_tile tile = m_conv->Get_Tile_FS(it);
+    for ( int d=0; d<dim-1; d++ )
+      k[d] = m_conv->Get_k_Table(d)[tile.idx[d]];
+    const double *k_last = m_conv->Get_k_Table(dim-1) + tile.idx[dim-1];
+
+    for ( int m=0; m<tile.n; m++ )
+    {
+      k[dim-1] = k_last[m];
+      const double U = mup.Eval();
+      m_conv_U[tile.l0+m] = ( std::isfinite(U) ) ? (U) : (0);
+    }
+  }
+
+  std::cout << "FYI: nonlocal U_k   : " << seq.U_k << (( seq.U_padding ) ? (" (zero-padded)") : ("")) << "\n";
+}
+
+/// Releases the transform and the kernel of Setup_Convolution()
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Free_Convolution()
+{
+  delete m_conv;
+  fftw_free( m_conv_U );
+  m_conv = nullptr;
+  m_conv_U = nullptr;
+}
+
+/// Index of the first point of a tile of the fields in the (possibly zero-padded) grid of m_conv
+template <class T, int dim, int no_int_states>
+int64_t CRT_Base_IF<T,dim,no_int_states>::Conv_Offset( const Fourier::grid_tile &tile ) const
+{
+  int64_t retval = 0;
+  for ( int d=0; d<dim; d++ )
+    retval += tile.idx[d]*m_conv_stride[d];
+  return retval;
+}
+
+/** Computes the nonlocal potential \f$ \int U(\vec{r}-\vec{r}') n(\vec{r}') d\vec{r}' \f$ with \f$ n = \sum_i w_i |\psi_i|^2 \f$
+  *
+  * The density is transformed with a r2c transform, multiplied by U_k and transformed back. The result is left in
+  * m_conv->Getp2InReal(), the point of a tile of the fields starts at Conv_Offset().
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Compute_Convolution()
+{
+  double *dens = m_conv->Getp2InReal();
+  // the c2r transform of the previous step has filled the padding
+  if ( m_conv->Get_Dim_RS() != m_no_of_pts )
+    std::memset( dens, 0, sizeof(double)*m_conv->Get_Dim_RS() );
+
+  #pragma omp parallel for
+  for ( int64_t it=0; it<m_fields[0]->Get_No_Tiles(); it++ )
+  {
+    const Fourier::grid_tile tile = m_fields[0]->Get_Tile(it);
+    double *dens_tile = dens + Conv_Offset( tile );
+    for ( int m=0; m<tile.n; m++ )
+      dens_tile[m] = 0;
+    for ( int i=0; i<no_int_states; i++ )
+    {
+      if ( m_conv_weights[i] == 0 ) continue;
+      const double w = m_conv_weights[i];
+      const fftw_complex *Psi = m_fields[i]->Getp2In() + tile.l0;
+      #pragma omp simd
+      for ( int m=0; m<tile.n; m++ )
+        dens_tile[m] += w*(Psi[m][0]*Psi[m][0]+Psi[m][1]*Psi[m][1]);
+    }
+  }
+
+  m_conv->ft(-1);
+
+  fftw_complex *dens_k = m_conv->Getp2Out();
+  #pragma omp parallel for
+  for ( int64_t it=0; it<m_conv->Get_No_Tiles_FS(); it++ )
+  {
+    const Fourier::grid_tile tile = m_conv->Get_Tile_FS(it);
+    #pragma omp simd
+    for ( int64_t l=tile.l0; l<tile.l0+tile.n; l++ )
+    {
+      dens_k[l][0] *= m_conv_U[l];
+      dens_k[l][1] *= m_conv_U[l];
+    }
+  }
+
+  m_conv->ft(1);
+}
+
+/** Transform the wavefunction (in real space) into or out of the co-moving frame
+  *
+  * @param enter true: \f$ \psi_c \rightarrow \exp(-i p_c \cdot \vec{r}) \psi_c \f$, false: the inverse
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Change_Frame( const bool enter )
+{
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    if ( m_frame_phase[c] == nullptr ) continue;
+
+    fftw_complex *Psi = m_fields[c]->Getp2In();
+    fftw_complex *phase = m_frame_phase[c];
+
+    #pragma omp parallel for
+    for ( int64_t it=0; it<m_fields[c]->Get_No_Tiles(); it++ )
+    {
+      const Fourier::grid_tile tile = m_fields[c]->Get_Tile(it);
+      if ( enter )
+        Kernels::Multiply_Conj( Psi+tile.l0, phase+tile.l0, tile.n );
+      else
+        Kernels::Multiply( Psi+tile.l0, phase+tile.l0, tile.n );
+    }
+  }
+}
+
+/** Computes the (half) kinetic part in the co-moving frame
+  *
+  * Like Do_FT_Step_full() and Do_FT_Step_half(), but every internal state uses its shifted kinetic exponential.
+  * @param half true for half a time step
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Do_FT_Step_Frame( const bool half )
+{
+  for ( int c=0; c<no_int_states; c++ )
+    m_fields[c]->ft(-1);
+
+  for ( int i=0; i<no_int_states; i++ )
+  {
+    fftw_complex *Psi = m_fields[i]->Getp2In();
+    fftw_complex *step = half ? m_frame_half_step[i] : m_frame_full_step[i];
+    if ( step == nullptr )
+      step = half ? this->m_half_step : this->m_full_step;
+
+    #pragma omp parallel for
+    for ( int64_t it=0; it<m_fields[i]->Get_No_Tiles(); it++ )
+    {
+      const Fourier::grid_tile tile = m_fields[i]->Get_Tile(it);
+      Kernels::Multiply( Psi+tile.l0, step+tile.l0, tile.n );
+    }
+  }
+
+  for ( int c=0; c<no_int_states; c++ )
+    m_fields[c]->ft(1);
+
+  m_header.t += half ? 0.5*m_header.dt : m_header.dt;
+}
+
+/** Propagator \f$ \exp(-i \Delta t V(t)) \f$ of a Hamiltonian that is the same on every grid point
+  *
+  * The Hamiltonian is evaluated once (with x = 0). With integrator="magnus4" it is evaluated at the two Gauss nodes
+  * \f$ t_{1,2} = t \mp \sqrt{3}/6 \, \Delta t \f$ and U is the product of the two exponentials of Magnus_Weights().
+  *
+  * @param t Time of the evaluation (unscaled, like m_header.t), midpoint of the step
+  * @param dt Time step (unscaled, like m_header.dt)
+  * @param diagonal The parser returns only the diagonal (freeprop) instead of the upper triangle (interact)
+  * @param U Result in row-major order (no_int_states^2 entries)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Uniform_Propagator( const double t, const double dt, const bool diagonal, gsl_complex *U )
+{
+  const int N = no_int_states;
+  const double dt_V = dt*this->Get_t_scale();
+
+  int nNum;
+  this->x = 0;
+  if ( !m_magnus )
+  {
+    this->t = t*this->Get_t_scale();
+    Uniform_Exponential( this->V_parser->Eval(nNum), dt_V, diagonal, U );
+    return;
+  }
+
+  std::vector<double> V[2];
+  for ( int e=0; e<2; e++ )
+  {
+    this->t = ( t + (2*e-1)*MAGNUS_NODE*dt )*this->Get_t_scale();
+    const double *V_ptr = this->V_parser->Eval(nNum);
+    V[e].assign( V_ptr, V_ptr+nNum );
+  }
+
+  double w[2][2];
+  Magnus_Weights( w );
+  std::vector<double> B(nNum);
+  gsl_complex U_e[2][N*N];
+  for ( int e=0; e<2; e++ )
+  {
+    for ( int j=0; j<nNum; j++ )
+      B[j] = w[e][0]*V[0][j] + w[e][1]*V[1][j];
+    Uniform_Exponential( B.data(), dt_V, diagonal, U_e[e] );
+  }
+
+  // the first factor acts first
+  for ( int i=0; i<N; i++ )
+  {
+    for ( int j=0; j<N; j++ )
+    {
+      gsl_complex sum = GSL_COMPLEX_ZERO;
+      for ( int k=0; k<N; k++ )
+        sum = gsl_complex_add( sum, gsl_complex_mul( U_e[1][i*N+k], U_e[0][k*N+j] ) );
+      U[i*N+j] = sum;
+    }
+  }
+}
+
+/** Exponential \f$ \exp(-i \Delta t V) \f$ of the parser results V (V_real, V_imag pairs)
+  *
+  * @param V Results of the parser, the diagonal (freeprop) or the upper triangle (interact)
+  * @param dt_V Time step (scaled)
+  * @param diagonal V contains only the diagonal
+  * @param U Result in row-major order (no_int_states^2 entries)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Uniform_Exponential( const double *V, const double dt_V, const bool diagonal, gsl_complex *U )
+{
+  const int N = no_int_states;
+
+  if ( diagonal )
+  {
+    for ( int i=0; i<N; i++ )
+    {
+      for ( int j=0; j<N; j++ )
+        U[i*N+j] = GSL_COMPLEX_ZERO;
+      double re, im;
+      sincos( -dt_V*V[2*i], &im, &re );
+      U[i*N+i] = {re,im};
+    }
+    return;
+  }
+
+  gsl_matrix_complex *H = gsl_matrix_complex_calloc(N,N);
+  int m = 0;
+  for ( int i=0; i<N; i++ )
+  {
+    for ( int j=i; j<N; j++ )
+    {
+      if ( i != j )
+      {
+        gsl_matrix_complex_set(H,i,j, {dt_V*V[2*m],dt_V*V[2*m+1]});
+        gsl_matrix_complex_set(H,j,i, {dt_V*V[2*m],-dt_V*V[2*m+1]});
+      }
+      else
+      {
+        gsl_matrix_complex_set(H,i,i, {dt_V*V[2*m],0});
+      }
+      m++;
+    }
+  }
+  Hermitian_Exponential<no_int_states> expm;
+  expm.Compute( H, U );
+  gsl_matrix_complex_free(H);
+}
+
+/** Weights of the commutator-free Magnus integrator of order 4 (Blanes and Moan)
+  *
+  * \f$ \Psi(t+\Delta t) = \exp(-i \Delta t (w_{10} H_1 + w_{11} H_2)) \exp(-i \Delta t (w_{00} H_1 + w_{01} H_2)) \Psi(t) \f$
+  * with \f$ H_{1,2} \f$ at the Gauss nodes, \f$ w_{00} = w_{11} = 1/4 + \sqrt{3}/6 \f$ and \f$ w_{01} = w_{10} = 1/4 - \sqrt{3}/6 \f$.
+  * The two factors need no commutators and the scheme is exact for a time independent Hamiltonian.
+  *
+  * @param w w[e] are the weights of H_1 and H_2 in the exponent of factor e (e = 0 acts first)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Magnus_Weights( double w[2][2] )
+{
+  w[0][0] = w[1][1] = 0.25 + MAGNUS_NODE;
+  w[0][1] = w[1][0] = 0.25 - MAGNUS_NODE;
+}
+
+/** Multiplies the internal state vector at every grid point by the same matrix U
+  *
+  * The grid is processed in tiles. The tile of all internal states is copied into separate real and imaginary
+  * planes and U is applied as one (N x N) times (N x tile length) complex matrix product, so the inner loops run
+  * contiguously over the points and the step streams through memory once.
+  *
+  * @param U Matrix in row-major order (no_int_states^2 entries)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Apply_Uniform_Propagator( const gsl_complex *U )
+{
+  const int N = no_int_states;
+  const int L = Fourier::cft_base<dim>::TILE_LENGTH;
+
+  double U_re[no_int_states*no_int_states];
+  double U_im[no_int_states*no_int_states];
+  for ( int i=0; i<N*N; i++ )
+  {
+    U_re[i] = GSL_REAL(U[i]);
+    U_im[i] = GSL_IMAG(U[i]);
+  }
+
+  vector<fftw_complex *> Psi;
+  for ( int i=0; i<no_int_states; i++ )
+    Psi.push_back(m_fields[i]->Getp2In());
+
+  #pragma omp parallel
+  {
+    std::vector<double> in_re( N*L ), in_im( N*L );
+    double out_re[L], out_im[L];
+
+    #pragma omp for
+    for ( int64_t it=0; it<m_fields[0]->Get_No_Tiles(); it++ )
+    {
+      const Fourier::grid_tile tile = m_fields[0]->Get_Tile(it);
+
+      for ( int c=0; c<N; c++ )
+      {
+        const fftw_complex *psi = Psi[c]+tile.l0;
+        for ( int m=0; m<tile.n; m++ )
+        {
+          in_re[c*L+m] = psi[m][0];
+          in_im[c*L+m] = psi[m][1];
+        }
+      }
+
+      for ( int i=0; i<N; i++ )
+      {
+        for ( int m=0; m<tile.n; m++ )
+        {
+          out_re[m] = 0;
+          out_im[m] = 0;
+        }
+        for ( int j=0; j<N; j++ )
+        {
+          const double ur = U_re[i*N+j];
+          const double ui = U_im[i*N+j];
+          const double *a_re = in_re.data()+j*L;
+          const double *a_im = in_im.data()+j*L;
+          for ( int m=0; m<tile.n; m++ )
+          {
+            out_re[m] += ur*a_re[m] - ui*a_im[m];
+            out_im[m] += ur*a_im[m] + ui*a_re[m];
+          }
+        }
+        fftw_complex *psi = Psi[i]+tile.l0;
+        for ( int m=0; m<tile.n; m++ )
+        {
+          psi[m][0] = out_re[m];
+          psi[m][1] = out_im[m];
+        }
+      }
+    }
+  }
+}
+
+/** Multiplies all fields in k-space by the kinetic exponential \f$ \exp(-i \tau \alpha k^2) \f$
+  *
+  * @param tau Time (unscaled, like m_header.dt)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Apply_Kinetic_Phase( const double tau )
+{
+  // alpha_i k_i^2 along each axis
+  std::array<std::vector<double>,dim> ekin;
+  for ( int d=0; d<dim; d++ )
+  {
+    const double *k = m_fields[0]->Get_k_Table(d);
+    const int n = ( d==0 ) ? (m_fields[0]->Get_Dim_X()) : ( ( d==1 ) ? (m_fields[0]->Get_Dim_Y()) : (m_fields[0]->Get_Dim_Z()) );
+    ekin[d].resize(n);
+    for ( int i=0; i<n; i++ )
+      ekin[d][i] = (k[i]*this->m_alpha[d])*k[i];
+  }
+
+  #pragma omp parallel
+  {
+    double phi[Fourier::cft_base<dim>::TILE_LENGTH];
+    fftw_complex e[Fourier::cft_base<dim>::TILE_LENGTH];
+
+    #pragma omp for
+    for ( int64_t it=0; it<m_fields[0]->Get_No_Tiles(); it++ )
+    {
+      const Fourier::grid_tile tile = m_fields[0]->Get_Tile(it);
+
+      double e_outer = 0;
+      for ( int d=0; d<dim-1; d++ )
+        e_outer += ekin[d][tile.idx[d]];
+      const double *e_last = ekin[dim-1].data() + tile.idx[dim-1];
+
+      for ( int m=0; m<tile.n; m++ )
+        phi[m] = -tau*(e_outer+e_last[m]);
+      Kernels::Exp_Phase( phi, e, tile.n );
+
+      for ( int c=0; c<no_int_states; c++ )
+        Kernels::Multiply( m_fields[c]->Getp2In()+tile.l0, e, tile.n );
+    }
+  }
+}
+
+/** Propagates a block of n steps exactly in k-space (plan.exact)
+  *
+  * For a Hamiltonian that depends neither on the position nor on psi the internal part V(t) commutes with the
+  * kinetic energy, which is the same for all internal states. The propagator of the block is then the product of
+  * \f$ \exp(-i n \Delta t \alpha k^2) \f$ and the time-ordered internal propagator, which needs no transforms in
+  * between. The internal propagator is a single exponential for time-independent Hamiltonians and the product of
+  * the step propagators at the midpoints of the steps otherwise. There is no splitting error, the block costs one
+  * pair of transforms per field.
+  *
+  * @param n Number of steps
+  * @param dt Step width (unscaled, like m_header.dt)
+  * @param diagonal The Hamiltonian has only diagonal entries (freeprop)
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Exact_Block( const int n, const double dt, const bool diagonal )
+{
+  const int N = no_int_states;
+  const double tau = n*dt;
+  const double t0 = m_header.t;
+
+  gsl_complex U[no_int_states*no_int_states];
+  if ( !this->time_dependent )
+  {
+    Uniform_Propagator( t0+0.5*tau, tau, diagonal, U );
+  }
+  else
+  {
+    gsl_complex U_step[no_int_states*no_int_states];
+    gsl_complex tmp[no_int_states*no_int_states];
+    for ( int i=0; i<N*N; i++ )
+      U[i] = ( i % (N+1) == 0 ) ? (GSL_COMPLEX_ONE) : (GSL_COMPLEX_ZERO);
+
+    // later steps act from the left
+    for ( int s=0; s<n; s++ )
+    {
+      Uniform_Propagator( t0+(s+0.5)*dt, dt, diagonal, U_step );
+      for ( int i=0; i<N; i++ )
       {
-        time_dependent = true;
-        //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
+        for ( int j=0; j<N; j++ )
+        {
+          gsl_complex sum = GSL_COMPLEX_ZERO;
+          for ( int k=0; k<N; k++ )
+            sum = gsl_complex_add( sum, gsl_complex_mul( U_step[i*N+k], U[k*N+j] ) );
+          tmp[i*N+j] = sum;
+        }
       }
-      if (item->first.rfind("psi_", 0) == 0) 
+      std::copy( tmp, tmp+N*N, U );
+    }
+  }
+
+  for ( int c=0; c<no_int_states; c++ )
+    m_fields[c]->ft(-1);
+  // U is the same for all k, so it can be applied in k-space together with the kinetic part. A diagonal U only
+  // changes the phase of each internal state, which is kept for Apply_Global_Phases() instead of a pass over the grid.
+  if ( diagonal )
+  {
+    for ( int i=0; i<N; i++ )
+      m_global_phase[i] = fmod( m_global_phase[i] + gsl_complex_arg( U[i*N+i] ), 2*M_PI );
+    m_global_phase_pending = true;
+  }
+  else
+  {
+    Apply_Uniform_Propagator( U );
+  }
+  Apply_Kinetic_Phase( tau );
+  for ( int c=0; c<no_int_states; c++ )
+    m_fields[c]->ft(1);
+
+  m_header.t = t0 + tau;
+}
+
+/** Multi-rate splitting: the potential or internal step of a time-dependent Hamiltonian in M sub-steps
+  *
+  * The step of width dt between two kinetic steps is replaced by M steps of width dt/M, each evaluated at its own
+  * midpoint. The kinetic steps and their transforms are not repeated, so strong and fast varying couplings can be
+  * resolved without reducing dt of the whole split step. M is the attribute substeps of the sequence, or chosen by
+  * Adaptive_Substeps() in every step for substeps="auto".
+  *
+  * @param seq Sequence that is passed on to the sub-step function
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Sub_Cycled_Step( sequence_item &seq )
+{
+  const double t_mid = m_header.t;
+  const double dt = m_header.dt;
+  const int M = ( m_sub_steps > 0 ) ? (m_sub_steps) : (Adaptive_Substeps());
+
+  // the kinetic tables are not used by the sub-steps, so m_header.dt is changed without Set_dt()
+  m_header.dt = dt/M;
+  for ( int m=0; m<M; m++ )
+  {
+    m_header.t = t_mid + ((m+0.5)/M-0.5)*dt;
+    (*m_sub_step_fct)(this,seq);
+  }
+  m_header.t = t_mid;
+  m_header.dt = dt;
+}
+
+/** Number of sub-steps for substeps="auto"
+  *
+  * The Hamiltonian is evaluated at the start and at the end of the step on up to SUBSTEP_PROBES grid points with a
+  * constant odd stride, so that localized beams are hit in every direction and not only at the box edges. The number
+  * of sub-steps M is chosen such that its largest change within one sub-step amounts to at most SUBSTEP_PHASE in the
+  * phase, \f$ \Delta t |V_{ij}(t+\Delta t/2)-V_{ij}(t-\Delta t/2)| / M \f$. The change is maximized over all
+  * processes, so that a distributed grid is sub-cycled the same way everywhere.
+  */
+template <class T, int dim, int no_int_states>
+int CRT_Base_IF<T,dim,no_int_states>::Adaptive_Substeps()
+{
+  const double dt_V = m_header.dt*this->Get_t_scale();
+  const int64_t stride = ( m_no_of_pts > SUBSTEP_PROBES ) ? ((m_no_of_pts/SUBSTEP_PROBES) | 1) : (1);
+
+  double dV = 0;
+  int nNum;
+  for ( int64_t l=0; l<m_no_of_pts; l+=stride )
+  {
+    this->x = this->m_fields[0]->Get_x(l);
+    if ( this->nonlinear )
+    {
+      for ( int i=0; i<no_int_states; i++ )
+      {
+        this->psi_real_array[i] = m_fields[i]->Getp2In()[l][0];
+        this->psi_imag_array[i] = m_fields[i]->Getp2In()[l][1];
+      }
+    }
+    this->t = (m_header.t-0.5*m_header.dt)*this->Get_t_scale();
+    double *V_ptr = this->V_parser->Eval(nNum);
+    std::vector<double> V0( V_ptr, V_ptr+nNum );
+    this->t = (m_header.t+0.5*m_header.dt)*this->Get_t_scale();
+    V_ptr = this->V_parser->Eval(nNum);
+    for ( int j=0; j<nNum; j++ )
+      dV = std::max( dV, fabs(V_ptr[j]-V0[j]) );
+  }
+  dV = m_fields[0]->Max( dV );
+
+  const double M = std::ceil( dt_V*dV/SUBSTEP_PHASE );
+  return ( M < 1 ) ? (1) : (( M > MAX_SUBSTEPS ) ? (MAX_SUBSTEPS) : (int(M)));
+}
+
+/** Solves the potential part of plane-wave couplings in the co-moving frame
+  *
+  * In the frame the coupling matrix A(t) is the same on every grid point, so \f$ \exp(-i \Delta t A(t)) \f$ is
+  * computed once per step and applied to all points. No trigonometric functions or eigenvalue problems are evaluated
+  * per point.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Plane_Wave_Step()
+{
+  gsl_complex U[no_int_states*no_int_states];
+  Uniform_Propagator( m_header.t, m_header.dt, false, U );
+  Apply_Uniform_Propagator( U );
+}
+
+/** Appends t and the observables of seq to the time series seq.obs_file
+  *
+  * The observables are the particle numbers N_c ("N") and the unnormalized expectation values of position ("x")
+  * and momentum ("p") of every internal state, see Get_Particle_Number, Expval_Position and Expval_Momentum.
+  * The file is replaced when a run first records to it, later sequences continue it (Compile_Sequences checks that their columns match).
+  *
+  * @param seq Sequence with the attributes obs_file and observables
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Record_Observables( const sequence_item &seq )
+{
+  const char *axis[] = {"x","y","z"};
+
+  std::vector<std::string> columns = {"t"};
+  for ( auto &obs : seq.observables )
+  {
+    for ( int c=0; c<no_int_states; c++ )
+    {
+      if ( obs == "N" )
+        columns.push_back( "N_" + std::to_string(c+1) );
+      else
+        for ( int i=0; i<dim; i++ )
+          columns.push_back( ((obs == "p") ? ("k") : ("")) + std::string(axis[i]) + "_" + std::to_string(c+1) );
+    }
+  }
+
+  std::vector<double> row = {m_header.t};
+  CPoint<dim> expval;
+  for ( auto &obs : seq.observables )
+  {
+    for ( int c=0; c<no_int_states; c++ )
+    {
+      if ( obs == "N" )
       {
-        nonlinear = true;
-        //cout << "Name: " << item->first << " Address: [0x" << item->second << "]\n";
+        row.push_back( this->Get_Particle_Number(c) );
+        continue;
       }
+      if ( obs == "x" )
+        this->Expval_Position( expval, c );
+      else
+        this->Expval_Momentum( expval, c );
+      for ( int i=0; i<dim; i++ )
+        row.push_back( expval[i] );
     }
-    /* Define Variables and Constants*/
-    // self-defined constants
-    std::map<std::string, double>::iterator it = this->m_params->m_map_constants.begin();
-    while(it != this->m_params->m_map_constants.end())
+  }
+
+  if ( !m_fields[0]->Is_Root() ) return;
+
+  auto it = m_time_series.find( seq.obs_file );
+  if ( it == m_time_series.end() )
+  {
+    it = m_time_series.emplace( seq.obs_file, std::unique_ptr<Output::Time_Series>(new Output::Time_Series( seq.obs_file, columns )) ).first;
+    std::cout << "FYI: observables   : " << seq.obs_file << "\n";
+  }
+  it->second->Push( row );
+}
+
+/** Sets up the Hamiltonian parser of a sequence and the dependencies of the Hamiltonian
+  *
+  * The expression is evaluated once, so that unknown names or syntax errors are reported before the propagation.
+  *
+  * @param seq Sequence with the expressions V_ij_real and V_ij_imag
+  * @param plan Receives the parser and the flags position_dependent, time_dependent and nonlinear
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Build_Parser( const sequence_item &seq, sequence_plan &plan )
+{
+  plan.parser.reset( new mu::Parser );
+  mu::Parser *parser = plan.parser.get();
+
+  /** Read in Hamiltonian strings from XML */
+  std::string V_expression = "";
+  V_expression += seq.V_real[0];
+  V_expression += ",";
+  V_expression += seq.V_imag[0];
+  for (int i = 1; i<seq.V_real.size(); i++)
+  {
+    V_expression += ",";
+    V_expression += seq.V_real[i];
+    V_expression += ",";
+    V_expression += seq.V_imag[i];
+  }
+
+  try
+  {
+    /* Set Hamiltonian to evaluate dependencies*/
+    parser->SetExpr(V_expression);
+    // Query the used variables
+    const std::map<std::string, double*> variables = parser->GetUsedVar();
+    plan.position_dependent = false;
+    plan.time_dependent = false;
+    plan.nonlinear = false;
+
+    for ( const auto &item : variables )
     {
-      this->V_parser->DefineConst(it->first, (double)it->second);
-      it++;
+      if ((item.first == "x" ) or (item.first == "y" ) or (item.first == "z" ))
+        plan.position_dependent = true;
+      if (item.first == "t")
+        plan.time_dependent = true;
+      if (item.first.rfind("psi_", 0) == 0)
+        plan.nonlinear = true;
     }
+    /* Define Variables and Constants*/
+    // self-defined constants
+    for ( const auto &it : this->m_params->m_map_constants )
+      parser->DefineConst(it.first, (double)it.second);
     // constants
-    this->V_parser->DefineConst("pi", (double)M_PI);
-    this->V_parser->DefineConst("e", (double)M_E);
+    parser->DefineConst("pi", (double)M_PI);
+    parser->DefineConst("e", (double)M_E);
     // variables
-    if (time_dependent == true) {this->V_parser->DefineVar("t", &this->t);}
-    if (position_dependent == true) 
+    if (plan.time_dependent == true) {parser->DefineVar("t", &this->t);}
+    if (plan.position_dependent == true)
     {
-      this->V_parser->DefineVar("x", &this->x[0]);
-      if (dim >=2) {this->V_parser->DefineVar("y", &this->x[1]);}
-      if (dim == 3) {this->V_parser->DefineVar("z", &this->x[2]);}
+      parser->DefineVar("x", &this->x[0]);
+      if (dim >=2) {parser->DefineVar("y", &this->x[1]);}
+      if (dim == 3) {parser->DefineVar("z", &this->x[2]);}
     }
 
-    if (nonlinear == true)
+    if (plan.nonlinear == true)
     {
       for (int i = 0; i < this->m_fields.size(); i++)
       {
         std::string tmp_str = "psi_";
         tmp_str += std::to_string(i+1);
         tmp_str += "_real";
-        this->V_parser->DefineVar(tmp_str, &this->psi_real_array[i] );
+        parser->DefineVar(tmp_str, &this->psi_real_array[i] );
         tmp_str = "psi_";
         tmp_str += std::to_string(i+1);
         tmp_str += "_imag";
-        this->V_parser->DefineVar(tmp_str, &this->psi_imag_array[i] );
+        parser->DefineVar(tmp_str, &this->psi_imag_array[i] );
       }
     }
 
     // Set the final Hamiltonian
-    this->V_parser->SetExpr(V_expression);
+    parser->SetExpr(V_expression);
+
+    int nNum = 0;
+    parser->Eval(nNum);
+    if ( nNum != 2*int(seq.V_real.size()) )
+      throw std::string("Error: the Hamiltonian of sequence " + std::to_string(plan.index+1) + " (" + seq.name + ") has " + std::to_string(nNum) + " instead of " + std::to_string(2*seq.V_real.size()) + " components\n");
+  }
+  catch (mu::Parser::exception_type &e)
+  {
+    throw std::string("Error: invalid Hamiltonian in sequence " + std::to_string(plan.index+1) + " (" + seq.name + "): " + e.GetMsg() + " (token " + e.GetToken() + ")\n");
+  }
+}
+
+/** Estimates the work, the output and the additional memory of a prepared sequence
+  *
+  * A kinetic step transforms every field forward and backward, the steps of a block are 1 half, Nk-1 full and 1 half
+  * kinetic step. The momentum_lattice engine and the exact propagation transform once per block.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Estimate_Cost( const sequence_item &seq, sequence_plan &plan ) const
+{
+  sequence_cost &cost = plan.cost;
+  const uint64_t pts = uint64_t(m_no_of_pts);
+  std::memset( &cost, 0, sizeof(sequence_cost) );
+
+  int64_t outputs = 0;
+  for ( size_t i=0; i<plan.blocks.size(); i++ )
+  {
+    const int64_t n = plan.blocks[i].first;
+    cost.steps += n;
+    if ( plan.lattice || plan.exact )
+    {
+      cost.ffts += 2*no_int_states;
+    }
+    else
+    {
+      cost.kinetic_steps += n+1;
+      cost.ffts += 2*no_int_states*(n+1);
+    }
+    if ( i < seq.output_times.size() || seq.output_times.empty() ) outputs++;
+  }
+
+  uint64_t conv_pts = 0;
+  if ( !seq.U_k.empty() )
+  {
+    conv_pts = pts*(( seq.U_padding ) ? (uint64_t(1) << dim) : (1));
+    cost.ffts += 2*cost.steps;
+    cost.memory += conv_pts*(sizeof(double)+sizeof(fftw_complex)/2) + conv_pts/2*sizeof(double);
+  }
+
+  if ( seq.output_freq == freq::each || seq.output_freq == freq::packed )
+    cost.output_frames = outputs*no_int_states;
+  if ( seq.output_freq == freq::last )
+    cost.output_frames = no_int_states;
+  const size_t alignment = File_Format::Alignment( this->m_file_format );
+  const uint64_t frame_bytes = File_Format::Encode( m_header, this->m_file_format ).size() + File_Format::Data_Size( m_header );
+  cost.output_bytes = uint64_t(cost.output_frames)*((frame_bytes+alignment-1)/alignment*alignment);
+
+  if ( plan.lattice && !plan.time_dependent )
+    cost.memory += pts*no_int_states*no_int_states*sizeof(fftw_complex);
+  // V_eval of Numerical_Diagonalization(), at both Gauss nodes for integrator="magnus4"
+  if ( seq.name == "interact" && !plan.lattice && !plan.frame && ( plan.position_dependent || plan.nonlinear ) )
+  {
+    const bool magnus = seq.integrator == "magnus4" && plan.time_dependent && !plan.nonlinear;
+    cost.memory += (magnus ? 2 : 1)*pts*2*seq.V_real.size()*sizeof(double);
+  }
+  if ( plan.frame )
+  {
+    int shifted = 0;
+    for ( int c=0; c<no_int_states; c++ )
+      if ( seq.coupling_orders.empty() || seq.coupling_orders[c] != 0 ) shifted++;
+    cost.memory += 3*pts*shifted*sizeof(fftw_complex);
+  }
+}
+
+/// Bytes of the fields, kinetic tables and potentials that are allocated for all sequences (per process)
+template <class T, int dim, int no_int_states>
+uint64_t CRT_Base_IF<T,dim,no_int_states>::Base_Memory() const
+{
+  const uint64_t pts = uint64_t(m_no_of_pts);
+  return pts*(no_int_states*sizeof(fftw_complex) + 2*sizeof(fftw_complex) + no_int_states*sizeof(double))
+       + m_kinetic_tables.size()*2*pts*sizeof(fftw_complex);
+}
+
+/** Precomputes the kinetic tables for all step widths of the plan if there is more than one and all fit into KINETIC_CACHE_SIZE
+  *
+  * Otherwise the tables are recomputed by Set_dt() whenever the step width changes.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Build_Kinetic_Tables()
+{
+  Free_Kinetic_Tables();
+
+  std::vector<double> dts;
+  for ( const auto &plan : m_plan )
+  {
+    if ( plan.custom || plan.lattice || plan.exact ) continue;
+    for ( const auto &block : plan.blocks )
+      if ( std::find( dts.begin(), dts.end(), block.second ) == dts.end() )
+        dts.push_back( block.second );
+  }
+  const uint64_t table_size = 2*uint64_t(m_no_of_pts)*sizeof(fftw_complex);
+  if ( dts.size() < 2 || dts.size()*table_size > KINETIC_CACHE_SIZE ) return;
+
+  const double backup_dt = m_header.dt;
+  for ( const double dt : dts )
+  {
+    this->Set_dt( dt );
+    fftw_complex *full = fftw_alloc_complex( m_no_of_pts );
+    fftw_complex *half = fftw_alloc_complex( m_no_of_pts );
+    memcpy( full, m_own_full_step, sizeof(fftw_complex)*m_no_of_pts );
+    memcpy( half, m_own_half_step, sizeof(fftw_complex)*m_no_of_pts );
+    m_kinetic_tables[dt] = {full, half};
+  }
+  this->Set_dt( backup_dt );
+}
+
+/// Frees the cached kinetic tables, m_full_step and m_half_step point to the own tables afterwards
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Free_Kinetic_Tables()
+{
+  if ( this->m_full_step != m_own_full_step )
+  {
+    // the own tables still hold an older step width
+    this->m_full_step = m_own_full_step;
+    this->m_half_step = m_own_half_step;
+    this->Init();
+  }
+  for ( auto &it : m_kinetic_tables )
+  {
+    fftw_free( it.second.first );
+    fftw_free( it.second.second );
+  }
+  m_kinetic_tables.clear();
+}
+
+/** Changes the step width, using the cached kinetic tables if available
+  *
+  * @param dt New step width
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Use_dt( const double dt )
+{
+  if ( this->Get_dt() == dt ) return;
+
+  auto it = m_kinetic_tables.find( dt );
+  if ( it != m_kinetic_tables.end() )
+  {
+    m_header.dt = dt;
+    this->m_full_step = it->second.first;
+    this->m_half_step = it->second.second;
+    return;
+  }
+  this->m_full_step = m_own_full_step;
+  this->m_half_step = m_own_half_step;
+  this->Set_dt( dt );
+}
+
+/** Validates and prepares all sequences before anything is propagated
+  *
+  * Checks the attributes of every sequence, resolves the step functions, builds the Hamiltonian parsers, divides the
+  * sequences into blocks between two outputs and precomputes the kinetic tables of all step widths. Errors are thrown as
+  * std::string. Prints the estimated work, output and memory of the whole run.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Compile_Sequences()
+{
+  V_parser = nullptr;
+  m_plan.clear();
+  m_plan.reserve( m_params->m_sequence.size() );
+
+  const bool distributed = m_fields[0]->Is_Distributed();
+  std::map<std::string,std::vector<std::string>> obs_files; // observables recorded to each obs_file
+
+  for ( size_t s=0; s<m_params->m_sequence.size(); s++ )
+  {
+    const sequence_item &seq = m_params->m_sequence[s];
+    const std::string where = " in sequence " + std::to_string(s+1) + " (" + seq.name + ")\n";
+
+    m_plan.emplace_back();
+    sequence_plan &plan = m_plan.back();
+    plan.index = s;
+    plan.step_fct = nullptr;
+    plan.lattice = false;
+    plan.frame = false;
+    plan.exact = false;
+    plan.position_dependent = false;
+    plan.time_dependent = false;
+    plan.nonlinear = false;
+    plan.max_duration = 0;
+    std::memset( &plan.cost, 0, sizeof(sequence_cost) );
+
+    auto fct = this->m_map_stepfcts.find( seq.name );
+    plan.custom = ( fct == this->m_map_stepfcts.end() || seq.name == "half_step" || seq.name == "full_step" );
+    if ( plan.custom )
+    {
+      std::cout << "FYI: sequence " << s+1 << " (" << seq.name << ") is not built in and is left to run_custom_sequence\n";
+      continue;
+    }
+    plan.step_fct = fct->second;
+
+    for ( const double d : seq.duration )
+      plan.max_duration = std::max( plan.max_duration, d );
+    if ( !(seq.dt > 0) ) throw std::string("Error: dt has to be positive" + where);
+    if ( seq.Nk < 1 ) throw std::string("Error: Nk has to be positive" + where);
+    if ( !(plan.max_duration > 0) ) throw std::string("Error: no duration" + where);
+
+    const size_t no_V = ( seq.name == "interact" ) ? (no_int_states*(no_int_states+1)/2) : (no_int_states);
+    if ( seq.V_real.size() != no_V || seq.V_imag.size() != no_V )
+      throw std::string("Error: " + std::to_string(no_V) + " pairs V_ij_real, V_ij_imag expected" + where);
+
+    plan.lattice = ( seq.engine == "momentum_lattice" );
+    if ( !plan.lattice && seq.engine != "split_step" && seq.engine != "auto" && seq.engine != "exact" )
+      throw std::string("Error: Invalid engine " + seq.engine + where);
+    // Plane-wave couplings with the split-step engine are propagated in their co-moving frame
+    plan.frame = !plan.lattice && !seq.coupling_k.empty();
+    if ( ( plan.lattice || plan.frame ) && seq.name != "interact" )
+      throw std::string("Error: plane-wave couplings (coupling_k) are only available for interact sequences" + where);
+    // These shift or pad the k-space grid, which needs the whole grid in each process
+    if ( distributed && ( plan.lattice || plan.frame || !seq.U_k.empty() ) )
+      throw std::string("Error: coupling_k, the momentum_lattice engine and U_k are not available for distributed grids" + where);
+    // Sequences continue the time series of an earlier one with the same obs_file, the columns have to match
+    if ( seq.obs_freq != freq::none )
+    {
+      auto it = obs_files.emplace( seq.obs_file, seq.observables ).first;
+      if ( it->second != seq.observables )
+        throw std::string("Error: other observables than in an earlier sequence are recorded to " + seq.obs_file + where);
+    }
+
+    Build_Parser( seq, plan );
+
+    // A position-independent linear Hamiltonian commutes with the kinetic energy
+    const bool exact = ( !plan.lattice && !plan.frame && !plan.position_dependent && !plan.nonlinear && !seq.gpe && seq.U_k.empty() );
+    if ( seq.engine == "exact" && !exact )
+      throw std::string("Error: the exact engine needs a Hamiltonian without x, y, z, psi, gpe, U_k and coupling_k" + where);
+    plan.exact = exact && seq.engine != "split_step";
+
+    if ( seq.output_times.empty() )
+    {
+      const int Nk = seq.Nk;
+      const int Na = int(plan.max_duration / seq.dt) / Nk;
+      plan.blocks.assign( Na, {Nk, seq.dt} );
+      if ( double(Na*Nk)*seq.dt != plan.max_duration )
+        std::cout << "FYI: double(Na*Nk)*seq.dt != max_duration" << where;
+      if ( Na == 0 )
+        std::cout << "FYI: duration is shorter than Nk*dt, nothing is propagated" << where;
+    }
+    else
+    {
+      // one block per output time, with the step width shortened to land exactly on it
+      double t0 = 0;
+      double last_dt = seq.dt;
+      for ( size_t i=0; i<=seq.output_times.size(); i++ )
+      {
+        const double t1 = ( i < seq.output_times.size() ) ? (seq.output_times[i]) : (plan.max_duration);
+        if ( i == seq.output_times.size() && t1-t0 <= 1e-9*plan.max_duration ) break; // no rest after the last output time
+        const int n = std::max( 1, int(std::ceil( (t1-t0)/seq.dt - 1e-9 )) );
+        double dt = (t1-t0)/n;
+        // equal intervals differ in the last digits (i*interval - (i-1)*interval), keep one width for them
+        if ( fabs(dt-last_dt) <= 1e-9*last_dt ) dt = last_dt;
+        plan.blocks.push_back( {n, dt} );
+        last_dt = dt;
+        t0 = t1;
+      }
+    }
+
+    Estimate_Cost( seq, plan );
+  }
+
+  Build_Kinetic_Tables();
+
+  sequence_cost total;
+  std::memset( &total, 0, sizeof(sequence_cost) );
+  for ( const auto &plan : m_plan )
+  {
+    total.steps += plan.cost.steps;
+    total.kinetic_steps += plan.cost.kinetic_steps;
+    total.ffts += plan.cost.ffts;
+    total.output_frames += plan.cost.output_frames;
+    total.output_bytes += plan.cost.output_bytes;
+    total.memory = std::max( total.memory, plan.cost.memory );
+  }
+  std::cout << "FYI: compiled " << m_plan.size() << " sequences: " << total.steps << " steps, " << total.ffts << " FFTs, "
+            << total.output_frames << " output frames (" << double(total.output_bytes)/double(1 << 20) << " MiB)\n";
+  std::cout << "FYI: estimated memory : " << double(Base_Memory()+total.memory)/double(1 << 20) << " MiB"
+            << (( distributed ) ? (" per process") : ("")) << ", " << m_kinetic_tables.size() << " cached kinetic tables\n";
+}
+
+/** Sets up a compiled sequence for the propagation
+  *
+  * Selects the Hamiltonian parser and the flags of the plan, the step width, the convolution, the GPE term, the
+  * static potential and the co-moving frame of the plane-wave couplings.
+  *
+  * @param plan Compiled sequence
+  * @param step_fct Potential step, replaced in the co-moving frame
+  * @param half_step_fct Half kinetic step, replaced in the co-moving frame
+  * @param full_step_fct Full kinetic step, replaced in the co-moving frame
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::Prepare_Sequence( const sequence_plan &plan, StepFunction &step_fct, StepFunction &half_step_fct, StepFunction &full_step_fct )
+{
+  const sequence_item &seq = m_params->m_sequence[plan.index];
+
+  this->V_parser = plan.parser.get();
+  position_dependent = plan.position_dependent;
+  time_dependent = plan.time_dependent;
+  nonlinear = plan.nonlinear;
+
+  this->Use_dt(seq.dt);
+
+  fftw_free( m_lattice_U );
+  m_lattice_U = nullptr;
+  Free_Plane_Wave_Frame();
+  Free_Convolution();
+  if ( !seq.U_k.empty() )
+    Setup_Convolution( seq );
+
+  m_gpe = seq.gpe;
+  if ( m_gpe )
+  {
+    Setup_GPE();
+    std::cout << "FYI: native GPE term with g_ij from CONSTANTS\n";
+  }
+  m_static_potential = ( seq.name == "freeprop" && position_dependent && !time_dependent && !nonlinear );
+  if ( m_static_potential )
+    Cache_Static_Potential();
+  if ( plan.lattice || plan.frame )
+    Setup_Plane_Wave_Coupling( seq );
+  if ( plan.frame )
+  {
+    Setup_Plane_Wave_Frame();
+    step_fct = &Plane_Wave_Step_Wrapper;
+    half_step_fct = &Do_FT_Step_half_Frame_Wrapper;
+    full_step_fct = &Do_FT_Step_full_Frame_Wrapper;
+  }
+
+  m_magnus = seq.integrator == "magnus4" && plan.time_dependent && !plan.nonlinear && !plan.lattice;
+  if ( seq.integrator == "magnus4" && !m_magnus )
+    std::cout << "FYI: integrator magnus4 is only used for time-dependent and linear Hamiltonians, using midpoint in sequence " << plan.index+1 << "\n";
+
+  // Fast time-dependent potentials or couplings are sub-cycled within each kinetic step
+  m_sub_steps = seq.substeps;
+  m_sub_step_fct = nullptr;
+  if ( plan.time_dependent && seq.substeps != 1 && !plan.lattice && !plan.exact )
+  {
+    m_sub_step_fct = step_fct;
+    step_fct = &Sub_Cycled_Step_Wrapper;
+  }
+}
+
+/** Estimates wall time, memory and output of all sequences (option --plan)
+  *
+  * Every built-in sequence is prepared as in run_sequence() and its potential step and kinetic step (or its
+  * momentum-lattice step and the transforms of a block, or one exact block) are timed at the actual grid size. Each
+  * measurement is repeated with Autotune::Time() until Autotune::MIN_TIME has passed, after one call for warming up.
+  * The predicted wall time scales these with the number of steps of the plan and does not include the output.
+  * The timed steps propagate the fields, so the fields and m_header are saved before and restored after every
+  * sequence (this needs one more copy of the fields). Nothing is written.
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::plan_sequence()
+{
+  StepFunction half_step_fct=nullptr;
+  StepFunction full_step_fct=nullptr;
+
+  try
+  {
+    half_step_fct = this->m_map_stepfcts.at("half_step");
+    full_step_fct = this->m_map_stepfcts.at("full_step");
+  }
+  catch (const std::out_of_range &oor)
+  {
+    std::cerr << "Critical Error: Invalid fct ptr to ft_half_step or ft_full_step ()" << oor.what() << ")\n";
+    exit(EXIT_FAILURE);
+  }
+
+  Compile_Sequences();
+
+  // the timed steps propagate the fields, they are restored after every sequence
+  const generic_header saved_header = m_header;
+  std::array<fftw_complex *,no_int_states> saved;
+  for ( int c=0; c<no_int_states; c++ )
+  {
+    saved[c] = fftw_alloc_complex( m_fields[c]->Get_Dim_RS() );
+    memcpy( saved[c], m_fields[c]->Getp2In(), m_fields[c]->Get_Dim_RS()*sizeof(fftw_complex) );
+  }
+  // all processes repeat a distributed step equally often
+  auto more = [this]( const double elapsed ) { return m_fields[0]->Sum( ( elapsed < Autotune::MIN_TIME ) ? (1) : (0) ) > 0; };
+  auto restore = [&]()
+  {
+    for ( int c=0; c<no_int_states; c++ )
+      memcpy( m_fields[c]->Getp2In(), saved[c], m_fields[c]->Get_Dim_RS()*sizeof(fftw_complex) );
+    m_header = saved_header;
+    m_global_phase.fill(0);
+    m_global_phase_pending = false;
+  };
+
+  double total_time = 0;
+  int64_t total_frames = 0;
+  uint64_t total_bytes = 0;
+  uint64_t seq_memory = 0;
+
+  for ( auto &plan : m_plan )
+  {
+    sequence_item &seq = m_params->m_sequence[plan.index];
+    seq_memory = std::max( seq_memory, plan.cost.memory );
+    total_frames += plan.cost.output_frames;
+    total_bytes += plan.cost.output_bytes;
+
+    if ( plan.custom )
+    {
+      std::cout << "PLAN: sequence " << plan.index+1 << " (" << seq.name << ") is a custom sequence and not estimated\n";
+      continue;
+    }
+
+    StepFunction step_fct = plan.step_fct;
+    StepFunction seq_half_step_fct = half_step_fct;
+    StepFunction seq_full_step_fct = full_step_fct;
+    Prepare_Sequence( plan, step_fct, seq_half_step_fct, seq_full_step_fct );
 
-    /* for debugging parser
-    // Get the map with the used variables
-    const std::map<std::__cxx11::basic_string<char>, double*> variable =  this->V_parser->GetUsedVar();
-    // Get the number of variables 
-    std::map<std::__cxx11::basic_string<char>, double*>::const_iterator items = variable.begin();
-    // Query the variables
-    for (; items!=variable.end(); ++items)
+    double t_step = 0, t_kinetic = 0;
+    if ( plan.lattice )
     {
-        cout << "Name: " << items->first << " Address: [0x" << items->second << " Value: " << *items->second << "]\n";
+      const double t_ft = Autotune::Time( [&]()
+      {
+        for ( int c=0; c<no_int_states; c++ )
+          m_fields[c]->ft(-1);
+        for ( int c=0; c<no_int_states; c++ )
+          m_fields[c]->ft(1);
+      }, more );
+      for ( int c=0; c<no_int_states; c++ )
+        m_fields[c]->ft(-1);
+      // the call for warming up caches the propagators of time-independent Hamiltonians
+      t_step = Autotune::Time( [&]() { Momentum_Lattice_Step(); }, more );
+      plan.cost.wall_time = plan.blocks.size()*t_ft + plan.cost.steps*t_step;
+    }
+    else if ( plan.exact )
+    {
+      // the blocks only differ in the number of internal propagators, which is negligible for time-independent Hamiltonians
+      if ( !plan.blocks.empty() )
+        t_step = Autotune::Time( [&]() { Exact_Block( plan.blocks[0].first, plan.blocks[0].second, seq.name == "freeprop" ); }, more );
+      plan.cost.wall_time = plan.blocks.size()*t_step;
+    }
+    else
+    {
+      if ( plan.frame ) Change_Frame(true);
+      t_step = Autotune::Time( [&]() { (*step_fct)(this,seq); }, more );
+      t_kinetic = Autotune::Time( [&]() { (*seq_full_step_fct)(this,seq); }, more );
+      if ( plan.frame ) Change_Frame(false);
+      plan.cost.wall_time = plan.cost.steps*t_step + plan.cost.kinetic_steps*t_kinetic;
     }
-    */
+    restore();
+    total_time += plan.cost.wall_time;
+
+    if ( plan.exact )
+      std::cout << "PLAN: sequence " << plan.index+1 << " (" << seq.name << ") : " << plan.blocks.size() << " exact blocks of " << 1e3*t_step << " ms";
+    else
+      std::cout << "PLAN: sequence " << plan.index+1 << " (" << seq.name << ") : " << plan.cost.steps << " steps of " << 1e3*t_step << " ms";
+    if ( !plan.lattice && !plan.exact )
+      std::cout << ", " << plan.cost.kinetic_steps << " kinetic steps of " << 1e3*t_kinetic << " ms";
+    std::cout << ", " << plan.cost.output_frames << " output frames, " << plan.cost.wall_time << " s\n";
+
+    Free_Plane_Wave_Frame();
+    Free_Convolution();
+  }
+  for ( int c=0; c<no_int_states; c++ )
+    fftw_free( saved[c] );
+
+  const uint64_t pts = uint64_t(m_no_of_pts);
+  const double MiB = double(1 << 20);
+  const char *per_process = ( m_fields[0]->Is_Distributed() ) ? (" per process") : ("");
+  std::cout << "PLAN: fields          : " << double(no_int_states*pts*sizeof(fftw_complex))/MiB << " MiB" << per_process << "\n";
+  std::cout << "PLAN: kinetic tables  : " << double((1+m_kinetic_tables.size())*2*pts*sizeof(fftw_complex))/MiB << " MiB" << per_process << "\n";
+  std::cout << "PLAN: potentials      : " << double(no_int_states*pts*sizeof(double))/MiB << " MiB" << per_process << "\n";
+  std::cout << "PLAN: sequence buffers: " << double(seq_memory)/MiB << " MiB" << per_process << " (largest sequence: V_eval, propagators, convolution grid)\n";
+  std::cout << "PLAN: peak memory     : " << double(Base_Memory()+seq_memory)/MiB << " MiB" << per_process << "\n";
+  std::cout << "PLAN: output          : " << total_frames << " frames, " << double(total_bytes)/MiB << " MiB\n";
+  std::cout << "PLAN: wall time       : " << total_time << " s without output\n";
+}
+
+/** Run all the sequences defined in the xml file
+  *
+  * For furher information about the sequences see sequence_item
+  */
+template <class T, int dim, int no_int_states>
+void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
+{
+  if ( m_fields.size() != no_int_states )
+  {
+    std::cerr << "Critical Error: m_fields.size() != no_int_states\n";
+    exit(EXIT_FAILURE);
+  }
+
+  StepFunction half_step_fct=nullptr;
+  StepFunction full_step_fct=nullptr;
+  char filename[1024];
+
+  std::cout << "FYI: Found " << m_params->m_sequence.size() << " sequences." << std::endl;
+
+
+  try
+  {
+    half_step_fct = this->m_map_stepfcts.at("half_step");
+    full_step_fct = this->m_map_stepfcts.at("full_step");
+  }
+  catch (const std::out_of_range &oor)
+  {
+    std::cerr << "Critical Error: Invalid fct ptr to ft_half_step or ft_full_step ()" << oor.what() << ")\n";
+    exit(EXIT_FAILURE);
+  }
+
+  Compile_Sequences();
+
+  for ( const auto &plan : m_plan )
+  {
+    sequence_item &seq = m_params->m_sequence[plan.index];
+    const int seq_counter = int(plan.index)+1;
+
+    if ( run_custom_sequence(seq) ) continue;
+    if ( plan.custom )
+      throw std::string("Error: Invalid sequence name " + seq.name + "\n");
+
+    StepFunction step_fct = plan.step_fct;
+    StepFunction seq_half_step_fct = half_step_fct;
+    StepFunction seq_full_step_fct = full_step_fct;
+    Prepare_Sequence( plan, step_fct, seq_half_step_fct, seq_full_step_fct );
 
     std::cout << "FYI: started new sequence " << seq.name << "\n";
     if (time_dependent == true)
@@ -549,56 +2438,86 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
       std::cout << "and linear" << "\n";
     }
     std::cout << "FYI: sequence no : " << seq_counter << "\n";
-    std::cout << "FYI: duration    : " << max_duration << "\n";
+    std::cout << "FYI: duration    : " << plan.max_duration << "\n";
     std::cout << "FYI: dt          : " << seq.dt << "\n";
-    //std::cout << "FYI: Na          : " << Na << "\n";
-    //std::cout << "FYI: Nk          : " << Nk << "\n";
-    //std::cout << "FYI: Na*Nk*dt    : " << double(Na*Nk)*seq.dt << "\n";
-
-
-    if ( double(Na*Nk)*seq.dt != max_duration )
-      std::cout << "FYI: double(Na*Nk)*seq.dt != max_duration\n";
-
-    if ( this->Get_dt() != seq.dt )
-      this->Set_dt(seq.dt);
+    std::cout << "FYI: engine      : " << (( plan.exact ) ? ("exact") : (( plan.lattice ) ? ("momentum_lattice") : ("split_step"))) << "\n";
+    if ( !seq.output_times.empty() )
+      std::cout << "FYI: output times: " << seq.output_times.size() << " from " << seq.output_times.front() << " to " << seq.output_times.back() << "\n";
 
-    try
-    {
-      step_fct = this->m_map_stepfcts.at(seq.name);
-    }
-    catch (const std::out_of_range &oor)
-    {
-      std::cerr << "Critical Error: Invalid sequence name " << seq.name << "\n(" << oor.what() << ")\n";
-      exit(EXIT_FAILURE);
-    }
+    const bool lattice = plan.lattice;
+    const bool frame = plan.frame;
 
-    if ( seq.name == "freeprop" )
-    double backup_t = m_header.t;
-    double backup_end_t = m_header.t;
     for ( int k=0; k<no_int_states; k++ ) // Delete old packed Sequence
     {
       sprintf( filename, "Seq_%d_%d.bin", seq_counter, k+1 );
       std::remove(filename);
     }
 
-      for ( int i=1; i<=Na; i++ )
+      const std::vector<std::pair<int,double>> &blocks = plan.blocks;
+      const double seq_start_t = m_header.t;
+
+      for ( size_t i=0; i<blocks.size(); i++ )
       {
-        (*half_step_fct)(this,seq);
-        for ( int j=2; j<=Nk; j++ )
+        const int Nk_block = blocks[i].first;
+        if ( this->Get_dt() != blocks[i].second )
+        {
+          this->Use_dt( blocks[i].second );
+          // the cached propagators belong to the old step width
+          fftw_free( m_lattice_U );
+          m_lattice_U = nullptr;
+          if ( frame ) Setup_Plane_Wave_Frame();
+        }
+
+        if ( lattice ) // stay in k-space for the whole block
         {
+          for ( int c=0; c<no_int_states; c++ )
+            m_fields[c]->ft(-1);
+          for ( int j=1; j<=Nk_block; j++ )
+            Momentum_Lattice_Step();
+          for ( int c=0; c<no_int_states; c++ )
+            m_fields[c]->ft(1);
+        }
+        else if ( plan.exact )
+        {
+          Exact_Block( Nk_block, blocks[i].second, seq.name == "freeprop" );
+        }
+        else
+        {
+          if ( frame ) Change_Frame(true);
+          (*seq_half_step_fct)(this,seq);
+          for ( int j=2; j<=Nk_block; j++ )
+          {
+            (*step_fct)(this,seq);
+            (*seq_full_step_fct)(this,seq);
+          }
           (*step_fct)(this,seq);
-          (*full_step_fct)(this,seq);
+          (*seq_half_step_fct)(this,seq);
+          if ( frame ) Change_Frame(false);
+        }
+
+        if ( !seq.output_times.empty() )
+        {
+          // no accumulated rounding, the outputs are at the requested times
+          m_header.t = seq_start_t + (( i < seq.output_times.size() ) ? (seq.output_times[i]) : (plan.max_duration));
         }
-        (*step_fct)(this,seq);
-        (*half_step_fct)(this,seq);
 
         std::cout << "t = " << to_string(m_header.t) << std::endl;
 
+        if ( i >= seq.output_times.size() && !seq.output_times.empty() ) continue; // rest of the sequence after the last output time
+
+        // the particle numbers do not depend on the pending phases
+        if ( seq.output_freq == freq::each || seq.output_freq == freq::packed || seq.obs_freq == freq::each || ( seq.custom_freq == freq::each && m_custom_fct != nullptr ) )
+          Apply_Global_Phases();
+
         if ( seq.output_freq == freq::each )
         {
           for ( int k=0; k<no_int_states; k++ )
           {
-            sprintf( filename, "%.3f_%d.bin", this->Get_t(), k+1 );
+            // output schedules can be denser than the printed precision of t, number the files as well
+            if ( seq.output_times.empty() )
+              sprintf( filename, "%.3f_%d.bin", this->Get_t(), k+1 );
+            else
+              sprintf( filename, "%.3f_%zu_%d.bin", this->Get_t(), i+1, k+1 );
             this->Save_Phi( filename, k );
           }
         }
@@ -618,11 +2537,15 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
             std::cout << "N[" << c << "] = " << this->Get_Particle_Number(c) << std::endl;
         }
 
+        if ( seq.obs_freq == freq::each )
+          Record_Observables( seq );
+
         if ( seq.custom_freq == freq::each && m_custom_fct != nullptr )
         {
           (*m_custom_fct)(this,seq);
         }
       }
+      Apply_Global_Phases();
 
       if (seq.output_freq == freq::last )
       {
@@ -639,12 +2562,20 @@ void CRT_Base_IF<T,dim,no_int_states>::run_sequence()
           std::cout << "N[" << c << "] = " << this->Get_Particle_Number(c) << std::endl;
       }
 
+      if ( seq.obs_freq == freq::last )
+        Record_Observables( seq );
+
       if ( seq.custom_freq == freq::last && m_custom_fct != nullptr )
       {
         (*m_custom_fct)(this,seq);
       }
 
-    seq_counter++;
+    Free_Plane_Wave_Frame();
+    Free_Convolution();
   } // end of sequence loop
+
+  for ( auto &ts : m_time_series )
+    ts.second->Flush();
+  this->Wait_Output();
 }
 #endif
@@ -23,6 +23,7 @@
 #define __class_CRT_shared__
 
 #include "my_structs.h"
+#include "file_format.h"
 #include "CPoint.h"
 #include "fftw3.h"
 #include <cmath>
@@ -125,16 +126,14 @@ public:
 protected:
   /** Read header of a file into #m_header
     *
+    * Files of all versions of File_Format are accepted.
     * @param filename Name of the file to be read
     * @param dim Dimensions of the file
     */
   void Read_header(const std::string &filename, const int dim)
   {
     //Read header into m_header
-    std::ifstream file1( filename, std::ifstream::binary );
-    if ( !file1.is_open() ) throw std::string( "Could not open file " + filename + ".\n" );
-    file1.read( (char *)&m_header, sizeof(generic_header) );
-    file1.close();
+    File_Format::Read_Header( filename, m_header );
 
     switch ( dim )
     {
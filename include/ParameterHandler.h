@@ -53,6 +53,23 @@ struct sequence_item
   int analyze; ///< output frequency for analyzing tools
   int Nk; ///< number of intermediate steps
   double time;
+
+  std::string engine; ///< propagation engine of the sequence ("auto", "split_step", "exact" or "momentum_lattice")
+  std::vector<std::string> coupling_k; ///< lattice vector of plane-wave couplings, one expression per spatial dimension
+  std::vector<int> coupling_orders; ///< momentum order of each internal state in units of coupling_k
+  int substeps; ///< potential or internal steps per kinetic step for time-dependent Hamiltonians, 0: adaptive
+  std::string integrator; ///< evaluation of the internal Hamiltonian in a step of interact ("midpoint" or "magnus4")
+
+  std::string U_k; ///< Fourier transform of a nonlocal interaction kernel as a function of kx, ky, kz (empty: none)
+  std::vector<double> U_weights; ///< weight of each internal state in the density that is convolved with U_k
+  bool U_padding; ///< zero-pad the density to twice the box size to remove the periodic images of U_k
+  bool gpe; ///< add the contact interaction sum_j g_ij |psi_j|^2 with g_ij from the CONSTANTS section
+
+  std::string obs_file; ///< time series file for the observables, .csv for text output (empty: none)
+  std::vector<std::string> observables; ///< observables recorded in obs_file ("N", "x", "p")
+  int obs_freq; ///< record frequency of the observables in obs_file
+
+  std::vector<double> output_times; ///< output times relative to the start of the sequence, empty: output after every Nk steps
 };
 
 struct analyze_item
@@ -72,6 +89,8 @@ public:
 
   void Get_Header( generic_header&, bool=true );
 
+  int Get_File_Format();
+  std::string Get_IO_Backend();
   std::string Get_simulation( const std::string );
 
   /** Returns value of a tag <string> in the Constant section of the xml file */
@@ -116,6 +135,7 @@ protected:
   void populate_simulation(); ///< populate m_map_simulation
   void populate_sequence(); ///< Read from sequence node and save in m_sequence
   void populate_analyze();
+  void populate_output_times( const pugi::xml_node &, sequence_item & ); ///< Read the output schedule of a sequence
 
   pugi::xml_document m_xml_doc; ///< load document here
   std::map<std::string,int> m_map_ai_type;
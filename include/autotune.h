@@ -0,0 +1,217 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "fftw3.h"
+#include "my_structs.h"
+#include "cft_base.h"
+#include "complex_kernels.h"
+
+#pragma once
+
+/** Selection of the thread count, the FFTW planner flags and the SIMD kernels for a grid (N_THREADS auto)
+  *
+  * Every candidate is timed with split steps (transform, kinetic multiply, back transform, phase multiply) of all
+  * internal states on the actual grid. The fastest configuration is stored in a cache file under a fingerprint of
+  * the grid, the number of internal states, the machine and the FFTW version, so that later runs skip the benchmark.
+  * If FFTW_MEASURE wins, the FFTW wisdom is stored next to the cache as well, so that later runs do not measure
+  * every transform again when they create their plans.
+  */
+namespace Autotune
+{
+  struct config
+  {
+    int threads; ///< OpenMP and FFTW threads
+    unsigned planner_flags; ///< FFTW_ESTIMATE or FFTW_MEASURE
+    Kernels::SIMD_LEVEL simd;
+    double step_time; ///< Seconds per split step of all internal states
+  };
+
+  /// Minimal time a candidate is measured for
+  const double MIN_TIME = 0.1;
+
+  /// Grid, number of internal states, host, CPU and FFTW version
+  std::string Fingerprint( const generic_header &, const int no_int_states, const int max_threads );
+  /// Cache file, MY_TUNE_FILE or ~/.talises_tune
+  std::string Cache_File();
+  /// FFTW wisdom next to the cache file (Cache_File() + ".wisdom")
+  std::string Wisdom_File();
+  /// Loads the plans of earlier FFTW_MEASURE runs, so that the transforms are not measured again
+  void Import_Wisdom();
+  /// Stores the plans created so far, including the ones of the convolution and of the co-moving frame
+  void Export_Wisdom();
+  /// Reads the configuration of a fingerprint, false if there is none
+  bool Load( const std::string &filename, const std::string &fingerprint, config & );
+  void Store( const std::string &filename, const std::string &fingerprint, const config & );
+  std::string Planner_Name( const unsigned );
+
+  /// Thread counts 1, 2, 4, ... and max_threads
+  std::vector<int> Thread_Candidates( const int max_threads );
+
+  /** Seconds per call of f, after one call for warming up
+    *
+    * f is repeated while more(elapsed seconds) is true, at least once. Distributed grids have to decide this
+    * together on all processes, since every call of f may communicate.
+    */
+  template <class F, class C>
+  double Time( F f, C more )
+  {
+    typedef std::chrono::steady_clock clock;
+    f();
+    int reps = 0;
+    double elapsed = 0;
+    const clock::time_point t0 = clock::now();
+    do
+    {
+      f();
+      reps++;
+      elapsed = std::chrono::duration<double>( clock::now()-t0 ).count();
+    }
+    while ( more( elapsed ) );
+    return elapsed/reps;
+  }
+
+  /// Seconds per call of f, repeated for at least MIN_TIME after one call for warming up
+  template <class F>
+  double Time( F f )
+  {
+    return Time( f, []( const double elapsed ) { return elapsed < MIN_TIME; } );
+  }
+
+  /** Times all candidates on transforms of type T and returns the fastest configuration
+    *
+    * Thread counts and planner flags are timed together, the SIMD level is chosen afterwards with the fastest of
+    * those. fftw_init_threads() has to be called before. The SIMD level is left at the last candidate, the caller
+    * applies the result.
+    *
+    * @param header Header of the grid
+    * @param no_int_states Number of internal states, i.e. transforms per step
+    * @param max_threads Largest thread count to try
+    */
+  template <class T>
+  config Tune( const generic_header &header, const int no_int_states, const int max_threads )
+  {
+    config best;
+    best.threads = 1;
+    best.planner_flags = FFTW_ESTIMATE;
+    best.simd = Kernels::Get_SIMD_Level();
+    best.step_time = -1;
+
+    std::vector<std::unique_ptr<T>> fields;
+    fftw_complex *kin = nullptr;
+    std::vector<double> phi;
+
+    auto setup = [&]()
+    {
+      fields.clear();
+      for ( int i=0; i<no_int_states; i++ )
+      {
+        fields.emplace_back( new T( header ) );
+        fields.back()->SetFix(false);
+      }
+      // data after planning, FFTW_MEASURE overwrites the arrays
+      const int64_t n = fields[0]->Get_Dim_RS();
+      const double amp = 1/sqrt(double(n));
+      phi.assign( n, 0 );
+      fftw_free( kin );
+      kin = fftw_alloc_complex( n );
+      for ( int64_t l=0; l<n; l++ )
+      {
+        phi[l] = 1e-3*double(l % 1024);
+        kin[l][0] = cos(phi[l]);
+        kin[l][1] = -sin(phi[l]);
+      }
+      for ( auto &f : fields )
+        for ( int64_t l=0; l<n; l++ )
+        {
+          f->Getp2In()[l][0] = amp;
+          f->Getp2In()[l][1] = 0;
+        }
+    };
+
+    auto multiply = [&]( T *f, const bool kinetic )
+    {
+      #pragma omp parallel for
+      for ( int64_t t=0; t<f->Get_No_Tiles(); t++ )
+      {
+        const Fourier::grid_tile tile = f->Get_Tile(t);
+        if ( kinetic )
+          Kernels::Multiply( f->Getp2In()+tile.l0, kin+tile.l0, tile.n );
+        else
+          Kernels::Multiply_Phase( f->Getp2In()+tile.l0, phi.data()+tile.l0, tile.n );
+      }
+    };
+
+    auto step = [&]()
+    {
+      for ( auto &f : fields )
+      {
+        f->ft(-1);
+        multiply( f.get(), true );
+        f->ft(1);
+        multiply( f.get(), false );
+      }
+    };
+
+    for ( const int threads : Thread_Candidates( max_threads ) )
+    {
+      for ( const unsigned flags : { unsigned(FFTW_ESTIMATE), unsigned(FFTW_MEASURE) } )
+      {
+        fftw_plan_with_nthreads( threads );
+        omp_set_num_threads( threads );
+        Fourier::Set_Planner_Flags( flags );
+        setup();
+        const double time = Time( step );
+        std::cout << "FYI: autotune " << threads << " threads, " << Planner_Name( flags ) << " : " << 1e3*time << " ms\n";
+        if ( best.step_time < 0 || time < best.step_time )
+        {
+          best.threads = threads;
+          best.planner_flags = flags;
+          best.step_time = time;
+        }
+      }
+    }
+
+    fftw_plan_with_nthreads( best.threads );
+    omp_set_num_threads( best.threads );
+    Fourier::Set_Planner_Flags( best.planner_flags );
+    setup();
+
+    double best_simd = -1;
+    for ( int level=Kernels::GENERIC; level<=Kernels::Get_Max_SIMD_Level(); level++ )
+    {
+      Kernels::Set_SIMD_Level( Kernels::SIMD_LEVEL(level) );
+      const double time = Time( [&]() { for ( auto &f : fields ) { multiply( f.get(), true ); multiply( f.get(), false ); } } );
+      std::cout << "FYI: autotune " << Kernels::Get_SIMD_Name( Kernels::SIMD_LEVEL(level) ) << " kernels : " << 1e3*time << " ms\n";
+      if ( best_simd < 0 || time < best_simd )
+      {
+        best.simd = Kernels::SIMD_LEVEL(level);
+        best_simd = time;
+      }
+    }
+
+    fields.clear();
+    fftw_free( kin );
+    return best;
+  }
+}
@@ -29,7 +29,7 @@ namespace Fourier
   class cft_1d : public Fourier::cft_base<1>
   {
   public:
-    cft_1d( const generic_header&, bool=true, bool=false );
+    cft_1d( const generic_header&, bool=true, bool=false, Fourier::TYPE=Fourier::TYPE::COMPLEX );
 
     void ft( int isign ); // -1 (forward) oder +1 (backward)
     void D1();
@@ -28,7 +28,7 @@ namespace Fourier
   class cft_2d : public Fourier::cft_base<2>
   {
   public:
-    cft_2d( const generic_header&, bool=true, bool=false );
+    cft_2d( const generic_header&, bool=true, bool=false, Fourier::TYPE=Fourier::TYPE::COMPLEX );
 
     void ft( int isign ); // -1 (forward) oder +1 (backward)
 
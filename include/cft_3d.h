@@ -28,7 +28,7 @@ namespace Fourier
   class cft_3d : public cft_base<3>
   {
   public:
-    cft_3d( const generic_header&, bool=true, bool=false );
+    cft_3d( const generic_header&, bool=true, bool=false, Fourier::TYPE=Fourier::TYPE::COMPLEX );
 
     void ft( int isign ); // -1 (forward) oder +1 (backward)
 
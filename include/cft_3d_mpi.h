@@ -0,0 +1,75 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#ifndef CFT_3D_MPI_H
+#define CFT_3D_MPI_H
+
+#include <vector>
+#include <mpi.h>
+#include "cft_base.h"
+
+namespace Fourier
+{
+  /** Class for Fourier transform in three dimensions with complex valued data, distributed over the processes of MPI_COMM_WORLD
+    *
+    * Slab decomposition: every process holds a contiguous block of x-planes, in real space as well as in Fourier space.
+    * The y-z planes are transformed locally. For the transform along x the data is transposed into y-slabs with an
+    * all-to-all exchange and transposed back afterwards. The local arrays, tiles, Get_x_Table(0) and Get_k_Table(0)
+    * cover the planes of the process, so loops over tiles work unchanged. Only the FFTW ordering (SetFix(false)) is
+    * available.
+    */
+  class cft_3d_mpi : public cft_base<3>
+  {
+  public:
+    cft_3d_mpi( const generic_header&, bool=true, bool=false, Fourier::TYPE=Fourier::TYPE::COMPLEX );
+    ~cft_3d_mpi();
+
+    void ft( int isign ); // -1 (forward) oder +1 (backward)
+    void SetFix( bool );
+
+    CPoint<3> Get_k(const int64_t) final;
+    CPoint<3> Get_x(const int64_t) final;
+
+    bool Is_Distributed() const { return true; }
+    bool Is_Root() const { return m_rank == 0; }
+    int64_t Get_Offset_RS() const;
+    double Sum( const double ) const;
+    double Max( const double ) const;
+    void Write_Data( const std::string&, const generic_header&, const fftw_complex *, const bool=false, const int=1 );
+
+  private:
+    static generic_header Local_Header( const generic_header&, Fourier::TYPE );
+    static void Split( const int, const int, std::vector<int> &, std::vector<int> & );
+
+    void transpose( const bool );
+    void scale( fftw_complex* data, const double fak );
+
+    int m_rank; /// Rank of this process
+    int m_no_ranks; /// Number of processes
+    int m_dim_x_global; /// Number of sampling points in x-dimension of the whole grid
+    int m_shift_x_global; /// Index shift in x-dimension of the whole grid
+    std::vector<int> m_x0, m_nx; /// First x-plane and number of x-planes of each process
+    std::vector<int> m_y0, m_ny; /// First y-row and number of y-rows of each process in the transposed layout
+    MPI_Datatype m_row_type; /// One row along z (m_dim_z complex values)
+
+    fftw_complex *m_pack; /// Send/receive buffer in x-slab layout
+    fftw_complex *m_work; /// Transposed data in y-slab layout (whole x-axis)
+    fftw_plan m_forwardPlan_x; /// Plan for the forward transformation along x on m_work
+    fftw_plan m_backwardPlan_x; /// Plan for the backward transformation along x on m_work
+  };
+}
+#endif
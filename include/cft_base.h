@@ -19,10 +19,16 @@
 #include <fstream>
 #include <cassert>
 #include <cstring>
+#include <vector>
+#include <array>
+#include <string>
 #include "fftw3.h"
 #include <cmath>
 #include "CPoint.h"
 #include "my_structs.h"
+#include "complex_kernels.h"
+#include "output.h"
+#include "file_format.h"
 
 #pragma once
 
@@ -30,6 +36,40 @@ namespace Fourier
 {
   enum TYPE { REAL, COMPLEX };
 
+  /**
+  * \brief Contiguous piece of a grid row
+  *
+  * The points l0 ... l0+n-1 share the indices of the outer axes and idx[dim-1] ... idx[dim-1]+n-1 along the
+  * last (contiguous) axis.
+  */
+  struct grid_tile
+  {
+    int64_t l0; ///< Linear array index of the first point
+    int idx[3]; ///< Array indices (i,j,k) of the first point
+    int n; ///< Number of points
+  };
+
+  /// FFTW planner flags of the transforms that are created afterwards
+  inline unsigned &Planner_Flags()
+  {
+    static unsigned flags = FFTW_ESTIMATE;
+    return flags;
+  }
+
+  inline unsigned Get_Planner_Flags()
+  {
+    return Planner_Flags();
+  }
+
+  /** Sets the FFTW planner flags (FFTW_ESTIMATE, FFTW_MEASURE, ...) of the transforms that are created afterwards
+    *
+    * Planning with FFTW_MEASURE or more overwrites the arrays, so the data must be set after the construction.
+    */
+  inline void Set_Planner_Flags( const unsigned flags )
+  {
+    Planner_Flags() = flags;
+  }
+
   template <int dim>
   class cft_base
   {
@@ -48,6 +88,9 @@ namespace Fourier
         throw;
       }
 
+      // The half spectrum of r2c transforms has no centred ordering
+      if ( m_type == Fourier::TYPE::REAL ) m_bfix = false;
+
       Setup(header);
 
       if ( m_type == Fourier::TYPE::COMPLEX )
@@ -110,7 +153,12 @@ namespace Fourier
       }
     }
 
-    void SetFix( bool bval ) { m_bfix = bval; };
+    void SetFix( bool bval )
+    {
+      if ( bval && m_type == Fourier::TYPE::REAL ) throw std::string("Error in " + std::string(__func__) + ": the fixed ordering is not available for r2c transforms\n");
+      m_bfix = bval;
+      Setup_Tables();
+    };
 
     void save( const std::string& filename, bool rs=true )
     {
@@ -129,6 +177,12 @@ namespace Fourier
         header.bComplex = false;
         header.fs = 0;
       }
+      else if ( !rs && ( m_type == Fourier::TYPE::COMPLEX ) )
+      {
+        header.nDatatyp = sizeof(fftw_complex);
+        header.bComplex = true;
+        header.fs = 1;
+      }
       else if ( !rs )
       {
         header.nDatatyp = sizeof(fftw_complex);
@@ -167,6 +221,65 @@ namespace Fourier
     virtual CPoint<dim> Get_k(const int64_t)=0;
     virtual CPoint<dim> Get_x(const int64_t)=0;
 
+    /**
+    * \brief Coordinates of the real-space grid along one axis
+    *
+    * @param ax Axis (0: x, 1: y, 2: z)
+    * @returns Array with Get_x(l)[ax] for every array index along the axis
+    */
+    const double * Get_x_Table( const int ax ) const { return m_x_table[ax].data(); }
+
+    /**
+    * \brief Transform variable along one axis
+    *
+    * @param ax Axis (0: x, 1: y, 2: z)
+    * @returns Array with Get_k(l)[ax] for every array index along the axis (respects SetFix)
+    */
+    const double * Get_k_Table( const int ax ) const { return m_k_table[ax].data(); }
+
+    /// Number of tiles of the (complex) array, see Get_Tile()
+    int64_t Get_No_Tiles() const { return m_no_tiles; }
+
+    /// Number of tiles of the Fourier space array m_out, see Get_Tile_FS()
+    int64_t Get_No_Tiles_FS() const { return m_no_tiles_fs; }
+
+    /**
+    * \brief Tiled iteration over the grid
+    *
+    * The array is an (i,j,k) nest whose last axis is contiguous. It is split into rows along the last axis and
+    * every row into tiles of at most TILE_LENGTH points, so that a parallel loop over the tiles has enough
+    * work items also in 1D. Together with Get_x_Table() and Get_k_Table() the loop over the points of a tile
+    * needs no divisions:
+    * \code
+    * for ( int64_t t=0; t<field->Get_No_Tiles(); t++ )
+    * {
+    *   const Fourier::grid_tile tile = field->Get_Tile(t);
+    *   for ( int m=0; m<tile.n; m++ ) { l = tile.l0+m; x_last = x_table[tile.idx[dim-1]+m]; ... }
+    * }
+    * \endcode
+    * @param t Tile number, 0 <= t < Get_No_Tiles()
+    */
+    grid_tile Get_Tile( const int64_t t ) const
+    {
+      return Make_Tile( t, m_dim_last, m_tiles_per_row );
+    }
+
+    /**
+    * \brief Tiled iteration over the Fourier space array m_out
+    *
+    * Same as Get_Tile() for complex transforms. For r2c transforms (Fourier::TYPE::REAL) the last axis of
+    * m_out has only Get_red_Dim() points, the non-negative frequencies. Get_k_Table() is valid for these
+    * indices as well.
+    * @param t Tile number, 0 <= t < Get_No_Tiles_FS()
+    */
+    grid_tile Get_Tile_FS( const int64_t t ) const
+    {
+      return Make_Tile( t, m_dim_last_fs, m_tiles_per_row_fs );
+    }
+
+    /// Maximum number of points of a tile
+    static const int TILE_LENGTH = 1024;
+
     double * Getp2InReal() { return m_in_real; }
     fftw_complex * Getp2In() { return m_in; }
     fftw_complex * Getp2Out() { return m_out; }
@@ -177,6 +290,124 @@ namespace Fourier
     int64_t Get_red_Dim() { return m_red_dim; };
     int64_t Get_Dim_RS() { return m_dim; }; /// total number of sampling points in real space
     int64_t Get_Dim_FS() { return m_dim_fs; }; /// total number of sampling points in fourier space
+    Fourier::TYPE Get_Type() { return m_type; };
+
+    /**
+    * \brief Hooks for transforms that are distributed over several processes (see cft_3d_mpi)
+    *
+    * A distributed transform holds only a part of the grid. The local arrays, tiles and tables cover this part,
+    * the functions below give its position in the whole grid and combine results of all processes. They are
+    * hidden (not overridden) by the distributed classes, the classes using the transforms are templates.
+    */
+    bool Is_Distributed() const { return false; }
+    /// Only this process writes shared files such as time series
+    bool Is_Root() const { return true; }
+    /// Index of the first local point in the whole real-space array
+    int64_t Get_Offset_RS() const { return 0; }
+    /// Sum of val over all processes
+    double Sum( const double val ) const { return val; }
+    /// Maximum of val over all processes
+    double Max( const double val ) const { return val; }
+
+    /**
+    * \brief Write header and the (local part of) data to a binary file
+    *
+    * The threads write disjoint parts of the data in parallel (Output::Write_Parallel).
+    * @param filename Name of the file
+    * @param header Header written in front of the data
+    * @param data Get_Dim_RS() complex values
+    * @param append Append header and data to the file instead of replacing it
+    * @param version File format version (see File_Format)
+    */
+    void Write_Data( const std::string& filename, const generic_header& header, const fftw_complex *data, const bool append=false, const int version=1 )
+    {
+      const std::vector<char> block = File_Format::Encode( header, version );
+      Output::Write_Parallel( filename, block.data(), block.size(), data, sizeof(fftw_complex)*m_dim, append, File_Format::Alignment(version) );
+    }
+  protected:
+    /**
+    * \brief Transform of real valued data (Fourier::TYPE::REAL)
+    *
+    * Forward: m_in_real --> m_out (half spectrum), backward: m_out --> m_in_real. The backward c2r transform
+    * overwrites m_out.
+    *
+    * @param isign Whether forward [isign = -1] or backward [isign = 1] fourier transformation is performed
+    * @param fak_fs Scaling factor of the forward transform
+    * @param fak_rs Scaling factor of the backward transform
+    */
+    void ft_real( const int isign, const double fak_fs, const double fak_rs )
+    {
+      m_isign = isign;
+      if ( isign == -1 )
+      {
+        fftw_execute( m_forwardPlan );
+
+        #pragma omp parallel for
+        for ( int64_t t=0; t<m_no_tiles_fs; t++ )
+        {
+          const grid_tile tile = Get_Tile_FS(t);
+          Kernels::Scale( m_out+tile.l0, fak_fs, tile.n );
+        }
+      }
+      else if ( isign == 1 )
+      {
+        fftw_execute( m_backwardPlan );
+
+        #pragma omp parallel for
+        for ( int64_t t=0; t<m_no_tiles; t++ )
+        {
+          const grid_tile tile = Get_Tile(t);
+          double *data = m_in_real+tile.l0;
+          for ( int m=0; m<tile.n; m++ )
+            data[m] *= fak_rs;
+        }
+      }
+    }
+
+    /**
+    * \brief Derivatives of real valued data in m_in_real (Fourier::TYPE::REAL)
+    *
+    * The half spectrum is multiplied by i k_ax (order 1) or -k_ax^2 (order 2). ax = -1 applies the Laplacian.
+    *
+    * @param ax Axis (0: x, 1: y, 2: z) or -1
+    * @param order 1 or 2
+    */
+    void Diff_Real( const int ax, const int order )
+    {
+      ft(-1);
+
+      #pragma omp parallel for
+      for ( int64_t t=0; t<m_no_tiles_fs; t++ )
+      {
+        const grid_tile tile = Get_Tile_FS(t);
+
+        double k2_outer = 0;
+        for ( int d=0; d<dim-1; d++ )
+          if ( ax == -1 || ax == d ) k2_outer += m_k_table[d][tile.idx[d]]*m_k_table[d][tile.idx[d]];
+        const double *k_last = m_k_table[dim-1].data() + tile.idx[dim-1];
+
+        for ( int m=0; m<tile.n; m++ )
+        {
+          fftw_complex &z = m_out[tile.l0+m];
+          if ( order == 1 )
+          {
+            const double k = ( ax == dim-1 ) ? (k_last[m]) : (m_k_table[ax][tile.idx[ax]]);
+            const double tmp = z[0];
+            z[0] = -k*z[1];
+            z[1] = k*tmp;
+          }
+          else
+          {
+            const double f = -k2_outer - ( ( ax == -1 || ax == dim-1 ) ? (k_last[m]*k_last[m]) : (0) );
+            z[0] *= f;
+            z[1] *= f;
+          }
+        }
+      }
+
+      ft(1);
+    }
+
   protected:
 
     int m_dim_x; /// Number of sampling points in x-dimension
@@ -209,7 +440,74 @@ namespace Fourier
     fftw_plan m_backwardPlan; /// Plan for backward transformation
 
     generic_header m_header;
+
+    std::array<std::vector<double>,3> m_x_table; /// Coordinates along each axis
+    std::array<std::vector<double>,3> m_k_table; /// Transform variable along each axis
+    int m_dim_last; /// Number of sampling points along the last (contiguous) axis
+    int64_t m_tiles_per_row; /// Number of tiles per row of the last axis
+    int64_t m_no_tiles; /// Total number of tiles
+    int m_dim_last_fs; /// Number of points along the last axis of m_out
+    int64_t m_tiles_per_row_fs; /// Number of tiles per row of the last axis of m_out
+    int64_t m_no_tiles_fs; /// Total number of tiles of m_out
   private:
+    /// Tile t of an array with rows of n_last points, see Get_Tile()
+    grid_tile Make_Tile( const int64_t t, const int n_last, const int64_t tiles_per_row ) const
+    {
+      const int64_t row = t / tiles_per_row;
+      const int k0 = int(t - row*tiles_per_row)*TILE_LENGTH;
+
+      grid_tile retval;
+      retval.idx[0] = retval.idx[1] = retval.idx[2] = 0;
+      switch( dim )
+      {
+        case 1: retval.idx[0] = k0;
+        break;
+        case 2: retval.idx[0] = int(row);
+                retval.idx[1] = k0;
+        break;
+        case 3: retval.idx[0] = int(row / m_dim_y);
+                retval.idx[1] = int(row - int64_t(retval.idx[0])*m_dim_y);
+                retval.idx[2] = k0;
+        break;
+      }
+      retval.l0 = row*n_last + k0;
+      retval.n = ( n_last-k0 < TILE_LENGTH ) ? (n_last-k0) : (TILE_LENGTH);
+      return retval;
+    }
+
+    /**
+    * \brief Helper routine for filling the coordinate tables
+    *
+    * Same conventions as Get_x() and Get_k() of the derived classes.
+    */
+    void Setup_Tables()
+    {
+      const int n[3] = { m_dim_x, m_dim_y, m_dim_z };
+      const int shift[3] = { m_shift_x, m_shift_y, m_shift_z };
+      const double d[3] = { m_dx, m_dy, m_dz };
+      const double dk[3] = { m_dkx, m_dky, m_dkz };
+
+      for ( int ax=0; ax<3; ax++ )
+      {
+        m_x_table[ax].resize(n[ax]);
+        m_k_table[ax].resize(n[ax]);
+        for ( int i=0; i<n[ax]; i++ )
+        {
+          const int t_i = ( m_bfix ) ? (i) : ((i+shift[ax])%n[ax]);
+          m_x_table[ax][i] = double(i-shift[ax])*d[ax];
+          m_k_table[ax][i] = dk[ax]*double(t_i-shift[ax]);
+        }
+      }
+
+      m_dim_last = n[dim-1];
+      m_tiles_per_row = (m_dim_last+TILE_LENGTH-1)/TILE_LENGTH;
+      m_no_tiles = (m_dim/m_dim_last)*m_tiles_per_row;
+
+      m_dim_last_fs = ( m_type == Fourier::TYPE::REAL ) ? (int(m_red_dim)) : (m_dim_last);
+      m_tiles_per_row_fs = (m_dim_last_fs+TILE_LENGTH-1)/TILE_LENGTH;
+      m_no_tiles_fs = (m_dim_fs/m_dim_last_fs)*m_tiles_per_row_fs;
+    }
+
     /**
     * \brief Helper routine for setting up cft_base
     *
@@ -254,6 +552,8 @@ namespace Fourier
           break;
         }
       }
+
+      Setup_Tables();
     }
   };
 } // end of namespace
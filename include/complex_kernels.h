@@ -0,0 +1,68 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#include <cstdint>
+#include <string>
+#include "fftw3.h"
+
+#pragma once
+
+/** Vectorized kernels for interleaved complex arrays (fftw_complex)
+  *
+  * Every kernel exists in a generic, an AVX2 and an AVX-512 version. The version is selected at runtime
+  * from the capabilities of the CPU and can be lowered with Set_SIMD_Level(). The kernels work on a
+  * contiguous range of n points and are meant to be called on the tiles of the grid loops
+  * (see Fourier::cft_base::Get_Tile()), i.e. from inside OpenMP parallel regions.
+  */
+namespace Kernels
+{
+  enum SIMD_LEVEL { GENERIC=0, AVX2=1, AVX512=2 };
+
+  SIMD_LEVEL Get_Max_SIMD_Level();
+  SIMD_LEVEL Get_SIMD_Level();
+  void Set_SIMD_Level( const SIMD_LEVEL );
+  void Set_SIMD_Level( const std::string & );
+  std::string Get_SIMD_Name( const SIMD_LEVEL );
+
+  /// data[l] *= fak[l]
+  void Multiply( fftw_complex *data, const fftw_complex *fak, const int64_t n );
+  /// data[l] *= conj(fak[l])
+  void Multiply_Conj( fftw_complex *data, const fftw_complex *fak, const int64_t n );
+  /// data[l] *= (re + i im)
+  void Multiply_Const( fftw_complex *data, const double re, const double im, const int64_t n );
+
+  /// Accuracy of the phase kernels, absolute error of exp(i phi) in units of 2^-52
+  double Get_Sincos_ULP();
+  void Set_Sincos_ULP( const double );
+
+  /// e[l] = exp(i phi[l]), vectorized sincos with the accuracy selected by Set_Sincos_ULP()
+  void Exp_Phase( const double *phi, fftw_complex *e, const int64_t n );
+  /// e[l] = exp(i(phi0 + l dphi)), incremental rotations within the accuracy selected by Set_Sincos_ULP()
+  void Exp_Linear_Phase( const double phi0, const double dphi, fftw_complex *e, const int64_t n );
+  /// data[l] *= exp(i phi[l])
+  void Multiply_Phase( fftw_complex *data, const double *phi, const int64_t n );
+  /// data[l] *= exp(i(phi0 + l dphi))
+  void Multiply_Linear_Phase( fftw_complex *data, const double phi0, const double dphi, const int64_t n );
+  /// data[l] *= fak
+  void Scale( fftw_complex *data, const double fak, const int64_t n );
+  /// Swaps a[l] and b[l] and multiplies both by (-1)^l fak
+  void Swap_Scale_Alternating( fftw_complex *a, fftw_complex *b, const double fak, const int64_t n );
+  /// Swaps a[l] and b[l] and multiplies the new a[l] by (-1)^l fak_a and the new b[l] by (-1)^l fak_b
+  void Swap_Scale_Alternating( fftw_complex *a, fftw_complex *b, const double fak_a, const double fak_b, const int64_t n );
+  /// Sum of |data[l]|^2
+  double Norm2( const fftw_complex *data, const int64_t n );
+}
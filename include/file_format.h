@@ -0,0 +1,231 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#ifndef FILE_FORMAT_H
+#define FILE_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "my_structs.h"
+
+/** On-disk formats of the binary output files
+  *
+  * Version 1 (legacy) is a generic_header followed directly by the data. Version 2 starts every frame with a
+  * file_header in a block of ALIGNMENT bytes, the data follows at the end of this block and the frame is padded to
+  * a multiple of ALIGNMENT. Data sections of all frames in packed files are therefore page aligned. The readers
+  * recognize both versions.
+  */
+namespace File_Format
+{
+  /// Newest format version
+  const int VERSION = 2;
+  /// Alignment of data sections and frames in version 2
+  const uint32_t ALIGNMENT = 4096;
+  /// Written as uint32_t, reads back as SWAPPED_ENDIANNESS on a machine with the other byte order
+  const uint32_t ENDIANNESS = 0x01020304;
+  const uint32_t SWAPPED_ENDIANNESS = 0x04030201;
+  const char MAGIC[8] = {'T','A','L','I','S','E','S','\0'};
+
+  /// Memory layout of the data
+  enum LAYOUT { ROW_MAJOR=0 }; ///< x slowest, z fastest
+
+  /** Self-describing frame header of version 2 (all fields naturally aligned)
+    */
+  struct file_header
+  {
+    char     magic[8]; ///< MAGIC
+    uint32_t version; ///< format version (2)
+    uint32_t endianness; ///< ENDIANNESS in the byte order of the writer
+    uint32_t header_size; ///< bytes from the start of the frame to the data
+    uint32_t alignment; ///< data sections and frames start at multiples of this (relative to the file)
+    uint32_t nDims; ///< number of dimensions
+    uint32_t precision; ///< bytes per real number (8: double)
+    uint32_t bComplex; ///< 1: complex data, 0: real data
+    uint32_t layout; ///< LAYOUT of the data
+    uint32_t fs; ///< 1: Fourier space, 0: real space
+    int32_t  ks; ///< coordinate system
+    int32_t  bAtom;
+    int32_t  reserved;
+    int64_t  nDim[3]; ///< number of points in each dimension
+    uint64_t data_size; ///< bytes of data
+    uint64_t frame_size; ///< header_size + data_size rounded up to alignment
+    double   t;
+    double   dt;
+    double   M;
+    double   T_scale;
+    double   xMin[3];
+    double   xMax[3];
+    double   dx[3];
+    double   dk[3];
+  };
+
+  /// Number of data bytes of a frame described by header
+  inline uint64_t Data_Size( const generic_header &header )
+  {
+    const long long n[3] = { header.nDimX, header.nDimY, header.nDimZ };
+    uint64_t retval = uint64_t(header.nDatatyp);
+    for ( int i=0; i<header.nDims && i<3; i++ )
+      retval *= uint64_t(n[i]);
+    return retval;
+  }
+
+  /// Frames of this version start at multiples of the returned number of bytes
+  inline size_t Alignment( const int version )
+  {
+    return ( version >= 2 ) ? (ALIGNMENT) : (1);
+  }
+
+  /** Bytes of the header of a frame in the given format version
+    *
+    * @param header Description of the frame
+    * @param version 1 (generic_header) or 2 (file_header)
+    */
+  inline std::vector<char> Encode( const generic_header &header, const int version )
+  {
+    if ( version == 1 )
+    {
+      const char *p = reinterpret_cast<const char *>(&header);
+      return std::vector<char>( p, p+sizeof(generic_header) );
+    }
+    if ( version != 2 ) throw std::string("Error in " + std::string(__func__) + ": unknown file format " + std::to_string(version) + "\n");
+
+    file_header fh;
+    std::memset( &fh, 0, sizeof(file_header) );
+    std::memcpy( fh.magic, MAGIC, sizeof(MAGIC) );
+    fh.version = 2;
+    fh.endianness = ENDIANNESS;
+    fh.header_size = ALIGNMENT;
+    fh.alignment = ALIGNMENT;
+    fh.nDims = uint32_t(header.nDims);
+    fh.bComplex = ( header.bComplex ) ? (1) : (0);
+    fh.precision = uint32_t(( fh.bComplex ) ? (header.nDatatyp/2) : (header.nDatatyp));
+    fh.layout = ROW_MAJOR;
+    fh.fs = uint32_t(header.fs);
+    fh.ks = header.ks;
+    fh.bAtom = header.bAtom;
+    fh.nDim[0] = header.nDimX;
+    fh.nDim[1] = ( header.nDims > 1 ) ? (header.nDimY) : (1);
+    fh.nDim[2] = ( header.nDims > 2 ) ? (header.nDimZ) : (1);
+    fh.data_size = Data_Size( header );
+    fh.frame_size = (fh.header_size + fh.data_size + ALIGNMENT - 1)/ALIGNMENT*ALIGNMENT;
+    fh.t = header.t;
+    fh.dt = header.dt;
+    fh.M = header.M;
+    fh.T_scale = header.T_scale;
+    fh.xMin[0] = header.xMin; fh.xMin[1] = header.yMin; fh.xMin[2] = header.zMin;
+    fh.xMax[0] = header.xMax; fh.xMax[1] = header.yMax; fh.xMax[2] = header.zMax;
+    fh.dx[0] = header.dx; fh.dx[1] = header.dy; fh.dx[2] = header.dz;
+    fh.dk[0] = header.dkx; fh.dk[1] = header.dky; fh.dk[2] = header.dkz;
+
+    std::vector<char> retval( ALIGNMENT, 0 );
+    std::memcpy( retval.data(), &fh, sizeof(file_header) );
+    return retval;
+  }
+
+  /** Decodes the header at the start of a frame of either version
+    *
+    * @param buf Start of the frame
+    * @param size Bytes available at buf (at least sizeof(generic_header) for version 1)
+    * @param header Header in the legacy representation
+    * @param data_offset Bytes from the start of the frame to the data
+    * @param frame_size Bytes from the start of the frame to the next frame
+    * @return Format version of the frame
+    *
+    * Throws if frame_size of a version 2 header is zero, not a multiple of ALIGNMENT or smaller than header and data.
+    */
+  inline int Decode( const char *buf, const size_t size, generic_header &header, uint64_t &data_offset, uint64_t &frame_size )
+  {
+    if ( size >= sizeof(file_header) && std::memcmp( buf, MAGIC, sizeof(MAGIC) ) == 0 )
+    {
+      file_header fh;
+      std::memcpy( &fh, buf, sizeof(file_header) );
+      if ( fh.endianness == SWAPPED_ENDIANNESS ) throw std::string("Error in " + std::string(__func__) + ": file was written with the other byte order\n");
+      if ( fh.endianness != ENDIANNESS || fh.version < 2 || fh.version > uint32_t(VERSION) ) throw std::string("Error in " + std::string(__func__) + ": unknown file format version " + std::to_string(fh.version) + "\n");
+      if ( fh.layout != ROW_MAJOR || fh.precision != sizeof(double) ) throw std::string("Error in " + std::string(__func__) + ": unsupported layout or precision\n");
+
+      std::memset( &header, 0, sizeof(generic_header) );
+      header.nself = sizeof(generic_header);
+      header.nDatatyp = fh.precision*(( fh.bComplex ) ? (2) : (1));
+      header.nDims = fh.nDims;
+      header.nDimX = fh.nDim[0];
+      header.nDimY = fh.nDim[1];
+      header.nDimZ = fh.nDim[2];
+      header.nself_and_data = header.nself + fh.data_size;
+      header.bAtom = fh.bAtom;
+      header.bComplex = int(fh.bComplex);
+      header.t = fh.t;
+      header.dt = fh.dt;
+      header.M = fh.M;
+      header.T_scale = fh.T_scale;
+      header.ks = fh.ks;
+      header.fs = int(fh.fs);
+      header.xMin = fh.xMin[0]; header.yMin = fh.xMin[1]; header.zMin = fh.xMin[2];
+      header.xMax = fh.xMax[0]; header.yMax = fh.xMax[1]; header.zMax = fh.xMax[2];
+      header.dx = fh.dx[0]; header.dy = fh.dx[1]; header.dz = fh.dx[2];
+      header.dkx = fh.dk[0]; header.dky = fh.dk[1]; header.dkz = fh.dk[2];
+      // frame_size advances readers to the next frame, a corrupt value would loop forever or overlap frames
+      if ( fh.header_size < sizeof(file_header) || fh.data_size != Data_Size( header ) )
+        throw std::string("Error in " + std::string(__func__) + ": invalid header size or data size\n");
+      if ( fh.frame_size == 0 || fh.frame_size % ALIGNMENT != 0 || fh.frame_size < uint64_t(fh.header_size) + fh.data_size )
+        throw std::string("Error in " + std::string(__func__) + ": invalid frame size " + std::to_string(fh.frame_size) + "\n");
+      data_offset = fh.header_size;
+      frame_size = fh.frame_size;
+      return int(fh.version);
+    }
+
+    if ( size < sizeof(generic_header) ) throw std::string("Error in " + std::string(__func__) + ": incomplete header\n");
+    std::memcpy( &header, buf, sizeof(generic_header) );
+    data_offset = sizeof(generic_header);
+    frame_size = data_offset + Data_Size( header );
+    return 1;
+  }
+
+  /** Reads the header of the frame at the current position of a stream
+    *
+    * @param in Binary input stream
+    * @param header Header in the legacy representation
+    * @return Bytes from the start of the frame to the data
+    */
+  inline uint64_t Read_Header( std::istream &in, generic_header &header )
+  {
+    char buf[sizeof(generic_header) > sizeof(file_header) ? sizeof(generic_header) : sizeof(file_header)];
+    in.read( buf, sizeof(buf) );
+    const size_t size = size_t(in.gcount());
+    in.clear();
+
+    uint64_t data_offset, frame_size;
+    Decode( buf, size, header, data_offset, frame_size );
+    return data_offset;
+  }
+
+  /** Reads the header of the first frame of a file
+    *
+    * @param filename Name of the file
+    * @param header Header in the legacy representation
+    * @return Bytes from the start of the file to the data
+    */
+  inline uint64_t Read_Header( const std::string &filename, generic_header &header )
+  {
+    std::ifstream in( filename, std::ifstream::binary );
+    if ( !in.is_open() ) throw std::string( "Could not open file " + filename + ".\n" );
+    return Read_Header( in, header );
+  }
+}
+#endif
@@ -0,0 +1,168 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#pragma once
+
+/** Writers for the binary output files
+  */
+namespace Output
+{
+  /** Writes a header followed by a data block to a file
+    *
+    * The data block is split into contiguous regions which the OpenMP threads write with pwrite at
+    * precomputed offsets, so large snapshots are not limited by a single thread. Throws a std::string on errors.
+    *
+    * @param filename Name of the file
+    * @param header Header, written by one thread in front of the data
+    * @param header_size Size of the header in bytes
+    * @param data Data block
+    * @param data_size Size of the data block in bytes
+    * @param append Append header and data to the file instead of replacing it
+    * @param alignment The file is padded with zeros to a multiple of alignment bytes after the data
+    */
+  void Write_Parallel( const std::string &filename, const void *header, const size_t header_size, const void *data, const size_t data_size, const bool append=false, const size_t alignment=1 );
+
+  /** Buffered, append-only writer for time series of observables
+    *
+    * Every record is one row of doubles (usually t followed by the observables). Records are collected in a buffer,
+    * full buffers are written by a background thread, so the caller never waits for formatting or disk I/O.
+    *
+    * Binary layout: the 8 byte magic "TLSTS001", the number of columns as uint32_t, for every column a name of
+    * COLUMN_NAME_SIZE bytes (zero padded), followed by the records as native doubles. The CSV layout has one
+    * header line with the column names and one line per record.
+    */
+  class Time_Series
+  {
+  public:
+    static const size_t COLUMN_NAME_SIZE = 32;
+
+    /**
+      * @param filename Name of the file, a file ending in .csv is written as CSV, any other as binary
+      * @param columns Names of the columns
+      * @param append Continue an existing file with the same columns instead of replacing it
+      */
+    Time_Series( const std::string &filename, const std::vector<std::string> &columns, const bool append=false );
+    ~Time_Series();
+
+    Time_Series( const Time_Series& ) = delete;
+    Time_Series &operator=( const Time_Series& ) = delete;
+
+    /** Adds one record, the size of row has to match the number of columns */
+    void Push( const std::vector<double> &row );
+    /** Hands the buffered records to the background thread and waits until everything is on disk */
+    void Flush();
+
+    const std::vector<std::string> &Get_Columns() const { return m_columns; }
+    const std::string &Get_Filename() const { return m_filename; }
+
+  private:
+    void worker();
+    void write_block( const std::vector<double> & );
+
+    std::string m_filename;
+    std::vector<std::string> m_columns;
+    bool m_csv;
+    std::ofstream m_file;
+
+    std::vector<double> m_buffer; /// Records not yet handed to the writer thread
+    std::deque<std::vector<double>> m_queue; /// Full buffers waiting to be written
+    std::mutex m_mutex;
+    std::condition_variable m_cond_work; /// Signals new buffers or the shutdown to the writer thread
+    std::condition_variable m_cond_done; /// Signals an empty queue to Flush
+    bool m_busy; /// The writer thread is writing a buffer
+    bool m_stop;
+    std::string m_error; /// First error of the writer thread, rethrown by Push or Flush
+    std::thread m_thread;
+  };
+
+  /** Writes snapshots in the background, so that output overlaps with the propagation
+    *
+    * Submit copies header and data into a page aligned buffer and returns, a writer thread then writes the buffers in
+    * the order of submission. Frames that start and end at multiples of ALIGNMENT (file format 2) are written with
+    * O_DIRECT, bypassing the page cache. Other frames are written buffered and dropped from the page cache afterwards.
+    * The writes are submitted through io_uring if the kernel allows it, otherwise a pool of threads writes
+    * contiguous regions with pwrite. At most max_pending buffers are held, Submit waits if there are more.
+    */
+  class Async_Writer
+  {
+  public:
+    /// Buffers, offsets and sizes of direct writes are multiples of this
+    static const size_t ALIGNMENT = 4096;
+
+    /**
+      * @param no_io_threads Number of pwrite threads if io_uring is not available
+      * @param max_pending Maximum number of buffers waiting to be written
+      */
+    Async_Writer( const int no_io_threads=4, const size_t max_pending=2 );
+    ~Async_Writer();
+
+    Async_Writer( const Async_Writer& ) = delete;
+    Async_Writer &operator=( const Async_Writer& ) = delete;
+
+    /** Queues header and data for writing, see Write_Parallel for the parameters */
+    void Submit( const std::string &filename, const void *header, const size_t header_size, const void *data, const size_t data_size, const bool append=false, const size_t alignment=1 );
+    /** Waits until all submitted frames are written. Throws a std::string if a write failed. */
+    void Wait();
+    /** True if the writes go through io_uring, false if through the thread pool */
+    bool Uses_IO_Uring() const { return m_ring != nullptr; }
+
+  private:
+    struct Uring;
+    struct Job
+    {
+      std::string filename;
+      char *buffer; /// Header, data and zero padding (frame_size bytes, page aligned)
+      size_t capacity; /// Size of buffer
+      size_t frame_size;
+      bool append;
+    };
+
+    void worker();
+    void write_job( const Job & );
+    int write_regions( const int, const char *, const size_t, const off_t );
+
+    std::unique_ptr<Uring> m_ring; /// nullptr if io_uring is not available
+    std::vector<std::thread> m_pool; /// pwrite threads (empty if m_ring is used)
+    std::deque<std::function<void()>> m_tasks; /// Regions for the pwrite threads
+    std::mutex m_task_mutex;
+    std::condition_variable m_cond_tasks; /// Signals new regions or the shutdown to the pwrite threads
+    bool m_stop_pool;
+
+    size_t m_max_pending;
+    std::deque<Job> m_queue; /// Frames waiting to be written
+    std::vector<std::pair<char *,size_t>> m_free_buffers; /// Written buffers and their sizes, reused by Submit
+    std::mutex m_mutex;
+    std::condition_variable m_cond_work; /// Signals new frames or the shutdown to the writer thread
+    std::condition_variable m_cond_done; /// Signals written frames to Submit and Wait
+    bool m_busy; /// The writer thread is writing a frame
+    bool m_stop;
+    std::string m_error; /// First write error, rethrown by Submit or Wait
+    std::thread m_thread;
+  };
+}
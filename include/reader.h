@@ -0,0 +1,121 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#ifndef READER_H
+#define READER_H
+
+#include <complex>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "my_structs.h"
+#include "file_format.h"
+
+/** Read access to the binary output files of talises (library talises_reader)
+  *
+  * The files are mapped into memory, the frames are indexed once and all views point directly into the mapping.
+  * Reading a frame therefore only touches the pages that are actually used, no matter how large the file is.
+  */
+namespace Reader
+{
+  /** Zero-copy view of the grid of one frame
+    *
+    * The data is in row-major order (x slowest, z fastest), entry (i,j,k) belongs to the point
+    * (xMin+i*dx, yMin+j*dy, zMin+k*dz). Unused dimensions have n=1.
+    */
+  struct Grid_View
+  {
+    const generic_header *header; /// Header of the frame
+    const std::complex<double> *data; /// Complex data (nullptr if the frame is real)
+    const double *real_data; /// Real data (nullptr if the frame is complex)
+    int dims; /// Number of dimensions
+    int64_t n[3]; /// Number of points in each dimension
+    double x0[3]; /// First coordinate in each dimension
+    double dx[3]; /// Grid spacing in each dimension
+
+    int64_t Size() const { return n[0]*n[1]*n[2]; }
+    int64_t Index( const int64_t i, const int64_t j=0, const int64_t k=0 ) const { return (i*n[1]+j)*n[2]+k; }
+    const std::complex<double> &operator()( const int64_t i, const int64_t j=0, const int64_t k=0 ) const { return data[Index(i,j,k)]; }
+    double Coordinate( const int axis, const int64_t i ) const { return x0[axis]+double(i)*dx[axis]; }
+    /// Volume element dx*dy*dz of the used dimensions
+    double Volume_Element() const;
+  };
+
+  /** Memory mapped output file with one frame (e.g. 1.000_1.bin) or many frames (packed Seq_*_*.bin)
+    *
+    * All versions of File_Format are read, the headers are converted to generic_header.
+    */
+  class File
+  {
+  public:
+    explicit File( const std::string &filename );
+    ~File();
+
+    File( const File& ) = delete;
+    File &operator=( const File& ) = delete;
+    File( File&& );
+
+    const std::string &Get_Filename() const { return m_filename; }
+    size_t Get_No_Frames() const { return m_frames.size(); }
+    double Get_t( const size_t frame ) const { return m_frames[frame].header.t; }
+    const generic_header &Get_Header( const size_t frame ) const { return m_frames[frame].header; }
+    Grid_View Get_View( const size_t frame ) const;
+
+    /** Index of the frame closest to time t */
+    size_t Find( const double t ) const;
+
+  private:
+    struct Frame
+    {
+      generic_header header; /// Header in the legacy representation
+      const char *data;
+    };
+
+    std::string m_filename;
+    void *m_map; /// Mapping of the whole file
+    size_t m_size; /// Size of the file in bytes
+    std::vector<Frame> m_frames;
+    std::vector<size_t> m_by_time; /// Frame indices sorted by time
+  };
+
+  /** Number of particles, sum of |psi|^2 times the volume element (parallel) */
+  double Particle_Number( const Grid_View & );
+
+  /** Density |psi|^2 of all points (parallel)
+    *
+    * @param view Frame
+    * @param density Result, resized to view.Size()
+    */
+  void Density( const Grid_View &view, std::vector<double> &density );
+
+  /** Density |psi|^2 in the line (1D: point, 2D: line, 3D: plane) with a fixed index along one axis (parallel)
+    *
+    * @param view Frame
+    * @param axis Axis with the fixed index (0: x, 1: y, 2: z)
+    * @param index Fixed index along axis
+    * @param slice Result in row-major order of the remaining axes
+    */
+  void Slice( const Grid_View &view, const int axis, const int64_t index, std::vector<double> &slice );
+
+  /** Particle numbers of the internal states at the time closest to t
+    *
+    * @param components One file per internal state (e.g. Seq_1_1.bin, Seq_1_2.bin)
+    * @param t Time
+    */
+  std::vector<double> Populations( const std::vector<const File *> &components, const double t );
+}
+#endif
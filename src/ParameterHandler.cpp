@@ -33,8 +33,7 @@ ParameterHandler::ParameterHandler( const std::string filename )
   //Load xml file and get the first node
   if ( !m_xml_doc.load_file(filename.c_str()) )
   {
-    std::cerr << "Critical error occured during loading of file " << filename << std::endl;
-    throw;
+    throw std::string("Critical error occured during loading of file " + filename + "\n");
   }
 
   m_map_freq.insert(std::pair<std::string,int>("none",freq::none));
@@ -115,13 +114,11 @@ void ParameterHandler::populate_sequence()
 
 				if (std::strcmp(node.node().attribute(char_V_real).as_string(),"")==0)
 				{
-					printf( "No parameter %s specified.\n", char_V_real );
-					throw;
+					throw std::string("Error Parsing xml file: No parameter " + std::string(char_V_real) + " specified for sequence " + item.name + "\n");
 				}
 				if (std::strcmp(node.node().attribute(char_V_imag).as_string(),"")==0)
 				{
-					printf( "No parameter %s specified.\n", char_V_real );
-					throw;
+					throw std::string("Error Parsing xml file: No parameter " + std::string(char_V_imag) + " specified for sequence " + item.name + "\n");
 				}
 
 				item.V_real.push_back(node.node().attribute(char_V_real).as_string()) ;
@@ -146,13 +143,11 @@ void ParameterHandler::populate_sequence()
 
 			if (std::strcmp(node.node().attribute(char_V_real).as_string(),"")==0)
 			{
-				printf( "No parameter %s specified.\n", char_V_real );
-				throw;
+				throw std::string("Error Parsing xml file: No parameter " + std::string(char_V_real) + " specified for sequence " + item.name + "\n");
 			}
 			if (std::strcmp(node.node().attribute(char_V_imag).as_string(),"")==0)
 			{
-				printf( "No parameter %s specified.\n", char_V_real );
-				throw;
+				throw std::string("Error Parsing xml file: No parameter " + std::string(char_V_imag) + " specified for sequence " + item.name + "\n");
 			}
 
 			item.V_real.push_back(node.node().attribute(char_V_real).as_string()) ;
@@ -160,6 +155,99 @@ void ParameterHandler::populate_sequence()
 		}
     }
 
+    item.engine = node.node().attribute("engine").as_string("auto");
+    tmpstr = node.node().attribute("coupling_k").as_string("");
+    if ( tmpstr != "" )
+    {
+      strtk::parse(tmpstr,",",item.coupling_k);
+
+      vec.clear();
+      tmpstr = node.node().attribute("coupling_orders").as_string("");
+      strtk::parse(tmpstr,",",vec);
+      for ( auto i : vec )
+      {
+        try
+        {
+          item.coupling_orders.push_back(std::stoi(i));
+        }
+        catch ( const std::invalid_argument &ia )
+        {
+          std::cerr << "Error Parsing xml file: Unable to convert " << i << " to int for attribute coupling_orders of " << item.name << "\n";
+          throw;
+        }
+      }
+      if ( item.coupling_orders.size() != internal_dim )
+      {
+        throw std::string("Error Parsing xml file: coupling_orders of " + item.name + " needs one entry per internal state\n");
+      }
+    }
+
+    tmpstr = node.node().attribute("substeps").as_string("1");
+    if ( tmpstr == "auto" )
+    {
+      item.substeps = 0;
+    }
+    else
+    {
+      try
+      {
+        item.substeps = std::stoi(tmpstr);
+      }
+      catch ( const std::invalid_argument &ia )
+      {
+        throw std::string("Error Parsing xml file: substeps of " + item.name + " has to be a positive integer or auto\n");
+      }
+      if ( item.substeps < 1 )
+        throw std::string("Error Parsing xml file: substeps of " + item.name + " has to be a positive integer or auto\n");
+    }
+
+    item.integrator = node.node().attribute("integrator").as_string("midpoint");
+    if ( item.integrator != "midpoint" && item.integrator != "magnus4" )
+    {
+      throw std::string("Error Parsing xml file: integrator of " + item.name + " has to be midpoint or magnus4\n");
+    }
+    if ( item.integrator == "magnus4" && item.name != "interact" )
+    {
+      throw std::string("Error Parsing xml file: integrator magnus4 is only available for interact sequences\n");
+    }
+
+    item.gpe = node.node().attribute("gpe").as_bool(false);
+    if ( item.gpe && item.name != "freeprop" )
+    {
+      throw std::string("Error Parsing xml file: gpe is only available for freeprop sequences\n");
+    }
+
+    item.U_k = node.node().attribute("U_k").as_string("");
+    item.U_padding = node.node().attribute("U_padding").as_bool(false);
+    if ( item.U_k != "" )
+    {
+      if ( item.name != "freeprop" )
+      {
+        throw std::string("Error Parsing xml file: U_k is only available for freeprop sequences\n");
+      }
+
+      vec.clear();
+      tmpstr = node.node().attribute("U_weights").as_string("");
+      strtk::parse(tmpstr,",",vec);
+      for ( auto i : vec )
+      {
+        try
+        {
+          item.U_weights.push_back(std::stod(i));
+        }
+        catch ( const std::invalid_argument &ia )
+        {
+          std::cerr << "Error Parsing xml file: Unable to convert " << i << " to double for attribute U_weights of " << item.name << "\n";
+          throw;
+        }
+      }
+      if ( item.U_weights.empty() ) item.U_weights.assign(internal_dim,1.0);
+      if ( item.U_weights.size() != internal_dim )
+      {
+        throw std::string("Error Parsing xml file: U_weights of " + item.name + " needs one entry per internal state\n");
+      }
+    }
+
     tmpstr = node.node().attribute("output_freq").as_string("none");
     item.output_freq = m_map_freq[tmpstr];
     tmpstr = node.node().attribute("pn_freq").as_string("last");
@@ -169,6 +257,23 @@ void ParameterHandler::populate_sequence()
     tmpstr = node.node().attribute("analyze").as_string("none");
     item.analyze = m_map_freq[tmpstr];
 
+    item.obs_file = node.node().attribute("obs_file").as_string("");
+    tmpstr = node.node().attribute("obs_freq").as_string("each");
+    item.obs_freq = ( item.obs_file != "" ) ? (m_map_freq[tmpstr]) : (freq::none);
+    if ( item.obs_freq == freq::packed )
+    {
+      throw std::string("Error Parsing xml file: obs_freq of " + item.name + " has to be none, each or last\n");
+    }
+    tmpstr = node.node().attribute("observables").as_string("N");
+    strtk::parse(tmpstr,",",item.observables);
+    for ( auto &i : item.observables )
+    {
+      if ( i != "N" && i != "x" && i != "p" )
+      {
+        throw std::string("Error Parsing xml file: Unknown observable " + i + " for attribute observables of " + item.name + "\n");
+      }
+    }
+
 
     vec.clear();
     strtk::parse(item.content,",",vec);
@@ -186,10 +291,76 @@ void ParameterHandler::populate_sequence()
       }
       item.duration.push_back(val);
     }
+    populate_output_times( node.node(), item );
     m_sequence.push_back(item);
   }
 }
 
+/** Output schedule of a sequence in physical time
+  *
+  * One of the attributes output_times (explicit list), output_interval (uniform) or output_log ("t_first,n": n
+  * log-spaced times from t_first to the end of the sequence). The times are relative to the start of the sequence.
+  * With output_freq="each" the snapshots are named t_i_k.bin, i being the index of the output time.
+  */
+void ParameterHandler::populate_output_times( const pugi::xml_node &node, sequence_item &item )
+{
+  const std::string times = node.attribute("output_times").as_string("");
+  const std::string interval = node.attribute("output_interval").as_string("");
+  const std::string log = node.attribute("output_log").as_string("");
+  if ( int(times != "") + int(interval != "") + int(log != "") > 1 )
+  {
+    throw std::string("Error Parsing xml file: only one of output_times, output_interval and output_log can be set for " + item.name + "\n");
+  }
+
+  double max_duration = 0;
+  for ( auto d : item.duration )
+    max_duration = std::max( max_duration, d );
+
+  std::vector<std::string> vec;
+  std::vector<double> values;
+  strtk::parse( times + interval + log, ",", vec );
+  for ( auto i : vec )
+  {
+    try
+    {
+      values.push_back( std::stod(i) );
+    }
+    catch ( const std::invalid_argument &ia )
+    {
+      throw std::string("Error Parsing xml file: Unable to convert " + i + " to double for the output schedule of " + item.name + "\n");
+    }
+  }
+
+  item.output_times.clear();
+  if ( times != "" )
+  {
+    item.output_times = values;
+  }
+  else if ( interval != "" )
+  {
+    if ( values.size() != 1 || values[0] <= 0 )
+      throw std::string("Error Parsing xml file: output_interval of " + item.name + " has to be one positive number\n");
+    // counted, not summed, so that the last time is not lost to rounding
+    const int n = int( max_duration/values[0] + 1e-9 );
+    for ( int i=1; i<=n; i++ )
+      item.output_times.push_back( std::min( i*values[0], max_duration ) );
+  }
+  else if ( log != "" )
+  {
+    if ( values.size() != 2 || values[0] <= 0 || values[0] >= max_duration || values[1] < 2 )
+      throw std::string("Error Parsing xml file: output_log of " + item.name + " has to be t_first,n with 0 < t_first < duration and n >= 2\n");
+    const int n = int(values[1]);
+    for ( int i=0; i<n; i++ )
+      item.output_times.push_back( ( i == n-1 ) ? (max_duration) : (values[0]*std::pow( max_duration/values[0], double(i)/double(n-1) )) );
+  }
+
+  for ( size_t i=0; i<item.output_times.size(); i++ )
+  {
+    if ( item.output_times[i] <= 0 || item.output_times[i] > max_duration || ( i > 0 && item.output_times[i] <= item.output_times[i-1] ) )
+      throw std::string("Error Parsing xml file: output times of " + item.name + " have to be increasing and within (0,duration]\n");
+  }
+}
+
 void ParameterHandler::populate_analyze()
 {
   m_analyze.clear();
@@ -343,6 +514,26 @@ std::string ParameterHandler::Get_simulation( const std::string k )
   return (*it).second;
 }
 
+/// Version of the written binary files (SIMULATION key FILE_FORMAT, 1: legacy generic_header, 2: page aligned frames)
+int ParameterHandler::Get_File_Format()
+{
+  int retval=1;
+  auto it = m_map_simulation.find("FILE_FORMAT");
+  if ( it != m_map_simulation.end() ) retval = stoi((*it).second);
+  if ( retval < 1 || retval > 2 ) throw std::string( "Error: FILE_FORMAT has to be 1 or 2 in section SIMULATION.\n" );
+  return retval;
+}
+
+/// Writer of the binary files (SIMULATION key IO_BACKEND, "sync": parallel pwrite, "async": background writer with direct I/O)
+std::string ParameterHandler::Get_IO_Backend()
+{
+  std::string retval="sync";
+  auto it = m_map_simulation.find("IO_BACKEND");
+  if ( it != m_map_simulation.end() ) retval = (*it).second;
+  if ( retval != "sync" && retval != "async" ) throw std::string( "Error: IO_BACKEND has to be sync or async in section SIMULATION.\n" );
+  return retval;
+}
+
 double ParameterHandler::Get_Constant( const std::string k )
 {
   auto it = m_map_constants.find(k);
@@ -0,0 +1,122 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include "autotune.h"
+
+namespace Autotune
+{
+  std::string Fingerprint( const generic_header &header, const int no_int_states, const int max_threads )
+  {
+    char host[256] = "unknown";
+    gethostname( host, sizeof(host)-1 );
+    host[sizeof(host)-1] = 0;
+
+    std::ostringstream fp;
+    fp << header.nDims << "d_" << header.nDimX << "x" << header.nDimY << "x" << header.nDimZ
+       << "_N" << no_int_states << "_" << host << "_" << max_threads << "of" << std::thread::hardware_concurrency()
+       << "_" << Kernels::Get_SIMD_Name( Kernels::Get_Max_SIMD_Level() ) << "_" << fftw_version;
+
+    // one word per line in the cache file
+    std::string retval = fp.str();
+    for ( auto &c : retval )
+      if ( isspace(c) ) c = '_';
+    return retval;
+  }
+
+  std::string Cache_File()
+  {
+    const char *envstr = getenv( "MY_TUNE_FILE" );
+    if ( envstr != nullptr ) return std::string( envstr );
+    envstr = getenv( "HOME" );
+    return std::string( ( envstr != nullptr ) ? (envstr) : (".") ) + "/.talises_tune";
+  }
+
+  std::string Wisdom_File()
+  {
+    return Cache_File() + ".wisdom";
+  }
+
+  void Import_Wisdom()
+  {
+    const std::string filename = Wisdom_File();
+    if ( fftw_import_wisdom_from_filename( filename.c_str() ) )
+      std::cout << "FYI: FFTW wisdom from " << filename << "\n";
+  }
+
+  void Export_Wisdom()
+  {
+    const std::string filename = Wisdom_File();
+    if ( !fftw_export_wisdom_to_filename( filename.c_str() ) )
+      std::cout << "FYI: could not write the FFTW wisdom " << filename << "\n";
+  }
+
+  bool Load( const std::string &filename, const std::string &fingerprint, config &cfg )
+  {
+    std::ifstream in( filename );
+    std::string line;
+    bool found = false;
+    // the last entry of a fingerprint wins
+    while ( std::getline( in, line ) )
+    {
+      std::istringstream is( line );
+      std::string fp;
+      config tmp;
+      int simd;
+      if ( !(is >> fp >> tmp.threads >> tmp.planner_flags >> simd >> tmp.step_time) || fp != fingerprint ) continue;
+      if ( tmp.threads < 1 || simd < Kernels::GENERIC || simd > Kernels::Get_Max_SIMD_Level() ) continue;
+      tmp.simd = Kernels::SIMD_LEVEL(simd);
+      cfg = tmp;
+      found = true;
+    }
+    return found;
+  }
+
+  void Store( const std::string &filename, const std::string &fingerprint, const config &cfg )
+  {
+    std::ofstream out( filename, std::ofstream::app );
+    if ( !out.is_open() )
+    {
+      std::cout << "FYI: could not write the autotune cache " << filename << "\n";
+      return;
+    }
+    out << fingerprint << " " << cfg.threads << " " << cfg.planner_flags << " " << int(cfg.simd) << " " << cfg.step_time << "\n";
+  }
+
+  std::string Planner_Name( const unsigned flags )
+  {
+    if ( flags == FFTW_ESTIMATE ) return "FFTW_ESTIMATE";
+    if ( flags == FFTW_MEASURE ) return "FFTW_MEASURE";
+    if ( flags == FFTW_PATIENT ) return "FFTW_PATIENT";
+    return std::to_string( flags );
+  }
+
+  std::vector<int> Thread_Candidates( const int max_threads )
+  {
+    std::vector<int> retval;
+    for ( int n=1; n<max_threads; n*=2 )
+      retval.push_back( n );
+    retval.push_back( std::max( max_threads, 1 ) );
+    return retval;
+  }
+}
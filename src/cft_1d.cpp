@@ -21,6 +21,7 @@
 #include <cstdlib>
 #include <cstring>
 #include "cft_1d.h"
+#include "complex_kernels.h"
 
 namespace Fourier
 {
@@ -31,13 +32,22 @@ namespace Fourier
    *
    * @param header Header information to construct cft object
    * @param b Whether inplace transformation is done
+   * @param t Fourier::TYPE::COMPLEX (c2c) or Fourier::TYPE::REAL (r2c/c2r, always out of place)
    */
-  cft_1d::cft_1d( const generic_header &header, bool b, bool f ) : cft_base( header, b, f )
+  cft_1d::cft_1d( const generic_header &header, bool b, bool f, Fourier::TYPE t ) : cft_base( header, b, f, t )
   {
-    m_bfix = true;
+    SetFix( m_type == Fourier::TYPE::COMPLEX );
 
-    m_forwardPlan  = fftw_plan_dft_1d( m_dim, m_in, m_out, FFTW_FORWARD, FFTW_ESTIMATE );
-    m_backwardPlan = fftw_plan_dft_1d( m_dim, m_out, m_in, FFTW_BACKWARD, FFTW_ESTIMATE );
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      m_forwardPlan  = fftw_plan_dft_r2c_1d( m_dim, m_in_real, m_out, Get_Planner_Flags() );
+      m_backwardPlan = fftw_plan_dft_c2r_1d( m_dim, m_out, m_in_real, Get_Planner_Flags() );
+    }
+    else
+    {
+      m_forwardPlan  = fftw_plan_dft_1d( m_dim, m_in, m_out, FFTW_FORWARD, Get_Planner_Flags() );
+      m_backwardPlan = fftw_plan_dft_1d( m_dim, m_out, m_in, FFTW_BACKWARD, Get_Planner_Flags() );
+    }
 
     assert( m_forwardPlan != nullptr );
     assert( m_backwardPlan != nullptr );
@@ -57,6 +67,11 @@ namespace Fourier
   {
     m_isign = isign;
     if ( abs(isign) != 1 ) return;
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      ft_real( isign, m_dx/sqrt(2.0*M_PI), m_dkx/sqrt(2.0*M_PI) );
+      return;
+    }
     if ( isign == -1 )
     {
       fftw_execute( m_forwardPlan );
@@ -110,16 +125,15 @@ namespace Fourier
   */
   void cft_1d::D1()
   {
-    CPoint<1> k;
+    const double *k = Get_k_Table(0);
 
     ft(-1);
-    #pragma omp parallel for private(k)
-    for (int i=0; i<m_dim; i++ )
+    #pragma omp parallel for
+    for (int64_t i=0; i<m_dim_fs; i++ )
     {
       double tmp = m_out[i][0];
-      k = Get_k( i );
-      m_out[i][0] = k[0]*m_out[i][1];
-      m_out[i][1] = -k[0]*tmp;
+      m_out[i][0] = k[i]*m_out[i][1];
+      m_out[i][1] = -k[i]*tmp;
     }
     ft(1);
   }
@@ -131,14 +145,13 @@ namespace Fourier
    */
   void cft_1d::D2()
   {
-    CPoint<1> k;
+    const double *k = Get_k_Table(0);
 
     ft(-1);
-    #pragma omp parallel for private(k)
-    for (int i=0; i<m_dim; i++ )
+    #pragma omp parallel for
+    for (int64_t i=0; i<m_dim_fs; i++ )
     {
-      k = Get_k( i );
-      double f = -k[0]*k[0];
+      double f = -k[i]*k[i];
       m_out[i][0] = f*m_out[i][0];
       m_out[i][1] = f*m_out[i][1];
     }
@@ -153,25 +166,19 @@ namespace Fourier
    */
   void cft_1d::fix( fftw_complex *data, const double d )
   {
-    double fak = d / sqrt(2.0*M_PI);
+    const double fak = d / sqrt(2.0*M_PI);
 
-    fftw_complex tmp;
-
-    for ( int i=0; i<m_shift_x; i++ )
-    {
-      memcpy( &tmp, &data[i+m_shift_x], sizeof(fftw_complex) );
-      memcpy( &data[i+m_shift_x], &data[i], sizeof(fftw_complex) );
-      memcpy( &data[i], &tmp, sizeof(fftw_complex) );
-      data[i][0] *= fak;
-      data[i][1] *= fak;
-      data[i+m_shift_x][0] *= fak;
-      data[i+m_shift_x][1] *= fak;
-    }
+    // The halves are swapped in blocks of TILE_LENGTH points together with the scaling and the sign (-1)^i.
+    // The blocks start at even offsets, so the upper half only needs the sign (-1)^m_shift_x on top.
+    const double fak_2 = ( m_shift_x%2 == 1 ) ? (-fak) : (fak);
+    const int64_t no_blocks = (m_shift_x+TILE_LENGTH-1)/TILE_LENGTH;
 
-    for ( int i=1; i<m_dim; i+=2 )
+    #pragma omp parallel for schedule(static)
+    for ( int64_t b=0; b<no_blocks; b++ )
     {
-      data[i][0] *= -1.0;
-      data[i][1] *= -1.0;
+      const int64_t l0 = b*TILE_LENGTH;
+      const int64_t n = ( m_shift_x-l0 < TILE_LENGTH ) ? (m_shift_x-l0) : (TILE_LENGTH);
+      Kernels::Swap_Scale_Alternating( data+l0, data+m_shift_x+l0, fak, fak_2, n );
     }
   }
 
@@ -188,10 +195,10 @@ namespace Fourier
     const double fak = sx / sqrt(2.0*M_PI);
 
     #pragma omp parallel for
-    for ( int i=0; i<m_dim; i++ )
+    for ( int64_t t=0; t<m_no_tiles; t++ )
     {
-      data[i][0] *= fak;
-      data[i][1] *= fak;
+      const grid_tile tile = Get_Tile(t);
+      Kernels::Scale( data+tile.l0, fak, tile.n );
     }
   }
 }
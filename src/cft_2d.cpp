@@ -20,6 +20,7 @@
 #include <cstring>
 #include <cmath>
 #include "cft_2d.h"
+#include "complex_kernels.h"
 
 namespace Fourier
 {
@@ -30,11 +31,20 @@ namespace Fourier
    *
    * @param header Header information to construct cft object
    * @param b Whether inplace transformation is done
+   * @param t Fourier::TYPE::COMPLEX (c2c) or Fourier::TYPE::REAL (r2c/c2r, always out of place)
    */
-  cft_2d::cft_2d( const generic_header &header, bool b, bool f ) : cft_base( header, b, f )
+  cft_2d::cft_2d( const generic_header &header, bool b, bool f, Fourier::TYPE t ) : cft_base( header, b, f, t )
   {
-    m_forwardPlan  = fftw_plan_dft_2d( m_dim_x, m_dim_y, m_in, m_out, FFTW_FORWARD, FFTW_ESTIMATE );
-    m_backwardPlan = fftw_plan_dft_2d( m_dim_x, m_dim_y, m_out, m_in, FFTW_BACKWARD, FFTW_ESTIMATE );
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      m_forwardPlan  = fftw_plan_dft_r2c_2d( m_dim_x, m_dim_y, m_in_real, m_out, Get_Planner_Flags() );
+      m_backwardPlan = fftw_plan_dft_c2r_2d( m_dim_x, m_dim_y, m_out, m_in_real, Get_Planner_Flags() );
+    }
+    else
+    {
+      m_forwardPlan  = fftw_plan_dft_2d( m_dim_x, m_dim_y, m_in, m_out, FFTW_FORWARD, Get_Planner_Flags() );
+      m_backwardPlan = fftw_plan_dft_2d( m_dim_x, m_dim_y, m_out, m_in, FFTW_BACKWARD, Get_Planner_Flags() );
+    }
 
     assert( m_forwardPlan != nullptr );
     assert( m_backwardPlan != nullptr );
@@ -54,6 +64,11 @@ namespace Fourier
   {
     m_isign = isign;
     if ( abs(isign) != 1 ) return;
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      ft_real( isign, 0.5*m_dx*m_dy/M_PI, 0.5*m_dkx*m_dky/M_PI );
+      return;
+    }
     if ( isign == -1 )
     {
       fftw_execute( m_forwardPlan );
@@ -91,8 +106,8 @@ namespace Fourier
   CPoint<2> cft_2d::Get_k( const int64_t l )
   {
     CPoint<2> retval;
-    int64_t i = l / m_dim_y;
-    int64_t j = l - i*m_dim_y;
+    int64_t i = l / m_dim_last_fs;
+    int64_t j = l - i*m_dim_last_fs;
     if ( !m_bfix )
     {
       i = (i+m_shift_x)%m_dim_x;
@@ -228,6 +243,12 @@ namespace Fourier
     int ij, i2;
     double kx, tmp1;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 0, 1 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = true;
 
@@ -259,6 +280,12 @@ namespace Fourier
     int ij, j2;
     double ky, tmp1;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 1, 1 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -290,6 +317,12 @@ namespace Fourier
     int ij, i2;
     double kx;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 0, 2 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -321,6 +354,12 @@ namespace Fourier
     int ij, j2;
     double ky;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 1, 2 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -352,6 +391,12 @@ namespace Fourier
     int ij, i2, j2;
     double kx, ky, tmp1;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( -1, 2 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = true;
 
@@ -384,51 +429,15 @@ namespace Fourier
   {
     const double fak = 0.5 * sx * sy / M_PI;
 
-    #pragma omp parallel
+    // Row i is swapped with row i+m_shift_x, both rotated by m_shift_y, sign (-1)^(i+j)
+    #pragma omp parallel for
+    for ( int i=0; i<m_shift_x; i++ )
     {
-      double fak2, tmp;
+      fftw_complex *row_1 = data + int64_t(i)*m_dim_y;
+      fftw_complex *row_2 = data + int64_t(i+m_shift_x)*m_dim_y;
 
-      #pragma omp for collapse(2)
-      for ( int j=0; j<m_shift_y; j++ )
-      {
-        for ( int i=0; i<m_shift_x; i++ )
-        {
-          int ij_1 = j+i*m_dim_y;
-          int ij_2 = (j+m_shift_y)+(i+m_shift_x)*m_dim_y;
-
-          if ( (i+j)%2 == 1 ) fak2 = -fak;
-          else fak2 = fak;
-
-          tmp           = data[ij_1][0];
-          data[ij_1][0] = data[ij_2][0] * fak2;
-          data[ij_2][0] = tmp * fak2;
-
-          tmp           = data[ij_1][1];
-          data[ij_1][1] = data[ij_2][1] * fak2;
-          data[ij_2][1] = tmp * fak2;
-        }
-      }
-
-      #pragma omp for collapse(2)
-      for ( int j=m_shift_y; j<m_dim_y; j++ )
-      {
-        for ( int i=0; i<m_shift_x; i++ )
-        {
-          int ij_1 = j+i*m_dim_y;
-          int ij_2 = (j-m_shift_y)+(i+m_shift_x)*m_dim_y;
-
-          if ( (i+j)%2 == 1 ) fak2 = -fak;
-          else fak2 = fak;
-
-          tmp           = data[ij_1][0];
-          data[ij_1][0] = data[ij_2][0] * fak2;
-          data[ij_2][0] = tmp * fak2;
-
-          tmp           = data[ij_1][1];
-          data[ij_1][1] = data[ij_2][1] * fak2;
-          data[ij_2][1] = tmp * fak2;
-        }
-      }
+      Kernels::Swap_Scale_Alternating( row_1, row_2+m_shift_y, ( i%2 == 1 ) ? (-fak) : (fak), m_shift_y );
+      Kernels::Swap_Scale_Alternating( row_1+m_shift_y, row_2, ( (i+m_shift_y)%2 == 1 ) ? (-fak) : (fak), m_dim_y-m_shift_y );
     }
   }
 
@@ -446,10 +455,10 @@ namespace Fourier
     const double fak = 0.5 * sx * sy / M_PI;
 
     #pragma omp parallel for
-    for ( int64_t i=0; i<m_dim; i++ )
+    for ( int64_t t=0; t<m_no_tiles; t++ )
     {
-      data[i][0] *= fak;
-      data[i][1] *= fak;
+      const grid_tile tile = Get_Tile(t);
+      Kernels::Scale( data+tile.l0, fak, tile.n );
     }
   }
 
@@ -20,6 +20,7 @@
 #include <cmath>
 #include <cstring>
 #include "cft_3d.h"
+#include "complex_kernels.h"
 
 namespace Fourier
 {
@@ -30,11 +31,20 @@ namespace Fourier
    *
    * @param header Header information to construct cft object
    * @param b Whether inplace transformation is done
+   * @param t Fourier::TYPE::COMPLEX (c2c) or Fourier::TYPE::REAL (r2c/c2r, always out of place)
    */
-  cft_3d::cft_3d( const generic_header &header, bool b, bool f ) : cft_base( header, b, f )
+  cft_3d::cft_3d( const generic_header &header, bool b, bool f, Fourier::TYPE t ) : cft_base( header, b, f, t )
   {
-    m_forwardPlan  = fftw_plan_dft_3d( m_dim_x, m_dim_y, m_dim_z, m_in, m_out, FFTW_FORWARD, FFTW_ESTIMATE );
-    m_backwardPlan = fftw_plan_dft_3d( m_dim_x, m_dim_y, m_dim_z, m_out, m_in, FFTW_BACKWARD, FFTW_ESTIMATE );
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      m_forwardPlan  = fftw_plan_dft_r2c_3d( m_dim_x, m_dim_y, m_dim_z, m_in_real, m_out, Get_Planner_Flags() );
+      m_backwardPlan = fftw_plan_dft_c2r_3d( m_dim_x, m_dim_y, m_dim_z, m_out, m_in_real, Get_Planner_Flags() );
+    }
+    else
+    {
+      m_forwardPlan  = fftw_plan_dft_3d( m_dim_x, m_dim_y, m_dim_z, m_in, m_out, FFTW_FORWARD, Get_Planner_Flags() );
+      m_backwardPlan = fftw_plan_dft_3d( m_dim_x, m_dim_y, m_dim_z, m_out, m_in, FFTW_BACKWARD, Get_Planner_Flags() );
+    }
 
     assert( m_forwardPlan != nullptr );
     assert( m_backwardPlan != nullptr );
@@ -54,6 +64,11 @@ namespace Fourier
   {
     m_isign = isign;
     if ( abs(isign) != 1 ) return;
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      ft_real( isign, m_dx*m_dy*m_dz/pow(2*M_PI,1.5), m_dkx*m_dky*m_dkz/pow(2*M_PI,1.5) );
+      return;
+    }
     if ( isign == -1 )
     {
       fftw_execute( m_forwardPlan );
@@ -140,9 +155,10 @@ namespace Fourier
   CPoint<3> cft_3d::Get_k( const int64_t l )
   {
     CPoint<3> retval;
-    int64_t i = l / m_dim_y / m_dim_z;
-    int64_t j = (l - i*m_dim_y*m_dim_z) / m_dim_z;
-    int64_t k = l - i*m_dim_y*m_dim_z - j*m_dim_z;
+    const int64_t nz = m_dim_last_fs;
+    int64_t i = l / m_dim_y / nz;
+    int64_t j = (l - i*m_dim_y*nz) / nz;
+    int64_t k = l - i*m_dim_y*nz - j*nz;
     if ( !m_bfix )
     {
       i = (i+m_shift_x)%m_dim_x;
@@ -269,6 +285,12 @@ namespace Fourier
     int ijk, i2;
     double kx, tmp1;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 0, 1 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -303,6 +325,12 @@ namespace Fourier
     int ijk, j2;
     double ky, tmp1;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 1, 1 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -337,6 +365,12 @@ namespace Fourier
     int ijk, k2;
     double kz, tmp1;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 2, 1 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -371,6 +405,12 @@ namespace Fourier
     int ijk, i2;
     double kx;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 0, 2 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -405,6 +445,12 @@ namespace Fourier
     int ijk, j2;
     double ky;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 1, 2 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -439,6 +485,12 @@ namespace Fourier
     int ijk, k2;
     double kz;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( 2, 2 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -473,6 +525,12 @@ namespace Fourier
     int ijk, i2, j2, k2;
     double kx, ky, kz, tmp1;
 
+    if ( m_type == Fourier::TYPE::REAL )
+    {
+      Diff_Real( -1, 2 );
+      return;
+    }
+
     bool b_oldval = m_bfix;
     m_bfix = false;
 
@@ -508,103 +566,23 @@ namespace Fourier
    */
   void cft_3d::fix( fftw_complex *data, const double sx, const double sy, const double sz )
   {
-    int ijk_1, ijk_2;
-    double fak2, tmp;
     const double fak = sx * sy * sz / pow(2*M_PI,1.5);
 
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk_1,ijk_2,fak2,tmp)
+    // Every z-row (i,j) of the lower half in x is exchanged with the row (i+m_shift_x,j+m_shift_y), both
+    // rotated by m_shift_z. The sign (-1)^(i+j+k) is taken from the point in the first half of z. The rows
+    // are distributed statically, so every thread works on a contiguous block of rows and partner rows.
+    #pragma omp parallel for schedule(static) collapse(2)
     for ( int i=0; i<m_shift_x; i++ )
     {
-      for ( int j=0; j<m_shift_y; j++ )
-      {
-        for ( int k=0; k<m_shift_z; k++ )
-        {
-          ijk_1 = k+m_dim_z*(j+m_dim_y*i);
-          ijk_2 = (k+m_shift_z)+m_dim_z*((j+m_shift_y)+m_dim_y*(i+m_shift_x));
-
-          if ( (i+j+k)%2 == 1 ) fak2 = -fak;
-          else fak2 = fak;
-
-          tmp            = data[ijk_1][0];
-          data[ijk_1][0] = data[ijk_2][0] * fak2;
-          data[ijk_2][0] = tmp * fak2;
-
-          tmp            = data[ijk_1][1];
-          data[ijk_1][1] = data[ijk_2][1] * fak2;
-          data[ijk_2][1] = tmp * fak2;
-        }
-      }
-    }
-
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk_1,ijk_2,fak2,tmp)
-    for ( int i=m_shift_x; i<m_dim_x; i++ )
-    {
-      for ( int j=0; j<m_shift_y; j++ )
-      {
-        for ( int k=0; k<m_shift_z; k++ )
-        {
-          ijk_1 = k+m_dim_z*(j+m_dim_y*i);
-          ijk_2 = (k+m_shift_z)+m_dim_z*((j+m_shift_y)+m_dim_y*(i-m_shift_x));
-
-          if ( (i+j+k)%2 == 1 ) fak2 = -fak;
-          else fak2 = fak;
-
-          tmp            = data[ijk_1][0];
-          data[ijk_1][0] = data[ijk_2][0] * fak2;
-          data[ijk_2][0] = tmp * fak2;
-
-          tmp            = data[ijk_1][1];
-          data[ijk_1][1] = data[ijk_2][1] * fak2;
-          data[ijk_2][1] = tmp * fak2;
-        }
-      }
-    }
-
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk_1,ijk_2,fak2,tmp)
-    for ( int i=0; i<m_shift_x; i++ )
-    {
-      for ( int j=m_shift_y; j<m_dim_y; j++ )
-      {
-        for ( int k=0; k<m_shift_z; k++ )
-        {
-          ijk_1 = k+m_dim_z*(j+m_dim_y*i);
-          ijk_2 = (k+m_shift_z)+m_dim_z*((j-m_shift_y)+m_dim_y*(i+m_shift_x));
-
-          if ( (i+j+k)%2 == 1 ) fak2 = -fak;
-          else fak2 = fak;
-
-          tmp            = data[ijk_1][0];
-          data[ijk_1][0] = data[ijk_2][0] * fak2;
-          data[ijk_2][0] = tmp * fak2;
-
-          tmp            = data[ijk_1][1];
-          data[ijk_1][1] = data[ijk_2][1] * fak2;
-          data[ijk_2][1] = tmp * fak2;
-        }
-      }
-    }
-
-    #pragma omp parallel for schedule(dynamic,1) collapse(3) private(ijk_1,ijk_2,fak2,tmp)
-    for ( int i=m_shift_x; i<m_dim_x; i++ )
-    {
-      for ( int j=m_shift_y; j<m_dim_y; j++ )
+      for ( int j=0; j<m_dim_y; j++ )
       {
-        for ( int k=0; k<m_shift_z; k++ )
-        {
-          ijk_1 = k+m_dim_z*(j+m_dim_y*i);
-          ijk_2 = (k+m_shift_z)+m_dim_z*((j-m_shift_y)+m_dim_y*(i-m_shift_x));
-
-          if ( (i+j+k)%2 == 1 ) fak2 = -fak;
-          else fak2 = fak;
+        const int i2 = i+m_shift_x;
+        const int j2 = ( j < m_shift_y ) ? (j+m_shift_y) : (j-m_shift_y);
+        fftw_complex *row_1 = data + m_dim_z*(j+m_dim_y*int64_t(i));
+        fftw_complex *row_2 = data + m_dim_z*(j2+m_dim_y*int64_t(i2));
 
-          tmp            = data[ijk_1][0];
-          data[ijk_1][0] = data[ijk_2][0] * fak2;
-          data[ijk_2][0] = tmp * fak2;
-
-          tmp            = data[ijk_1][1];
-          data[ijk_1][1] = data[ijk_2][1] * fak2;
-          data[ijk_2][1] = tmp * fak2;
-        }
+        Kernels::Swap_Scale_Alternating( row_1, row_2+m_shift_z, ( (i+j)%2 == 1 ) ? (-fak) : (fak), m_shift_z );
+        Kernels::Swap_Scale_Alternating( row_1+m_shift_z, row_2, ( (i2+j2)%2 == 1 ) ? (-fak) : (fak), m_dim_z-m_shift_z );
       }
     }
   }
@@ -624,10 +602,10 @@ namespace Fourier
     const double fak = sx * sy * sz / pow(2*M_PI,1.5);
 
     #pragma omp parallel for
-    for ( int64_t i=0; i<m_dim; i++ )
+    for ( int64_t t=0; t<m_no_tiles; t++ )
     {
-      data[i][0] *= fak;
-      data[i][1] *= fak;
+      const grid_tile tile = Get_Tile(t);
+      Kernels::Scale( data+tile.l0, fak, tile.n );
     }
   }
 }
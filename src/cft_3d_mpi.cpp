@@ -0,0 +1,325 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include "cft_3d_mpi.h"
+#include "complex_kernels.h"
+
+namespace Fourier
+{
+  /**
+   * \brief cft_3d_mpi Constructor
+   *
+   * Complex Fourier Transformation in 3 dimension, distributed over the processes of MPI_COMM_WORLD.
+   * Every process has to construct the object with the header of the whole grid.
+   *
+   * @param header Header information of the whole grid
+   * @param b Whether inplace transformation is done
+   * @param f Ignored, the fixed ordering is not available
+   * @param t Only Fourier::TYPE::COMPLEX is available
+   */
+  cft_3d_mpi::cft_3d_mpi( const generic_header &header, bool b, bool f, Fourier::TYPE t ) : cft_base( Local_Header( header, t ), b, false, t )
+  {
+    MPI_Comm_rank( MPI_COMM_WORLD, &m_rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &m_no_ranks );
+
+    m_dim_x_global = header.nDimX;
+    m_shift_x_global = m_dim_x_global/2;
+    Split( m_dim_x_global, m_no_ranks, m_x0, m_nx );
+    Split( m_dim_y, m_no_ranks, m_y0, m_ny );
+    m_header = header;
+
+    // Coordinates of the local x-planes in the whole grid (FFTW ordering in Fourier space)
+    for ( int i=0; i<m_dim_x; i++ )
+    {
+      const int gi = m_x0[m_rank] + i;
+      m_x_table[0][i] = double(gi-m_shift_x_global)*m_dx;
+      m_k_table[0][i] = m_dkx*double((gi+m_shift_x_global)%m_dim_x_global-m_shift_x_global);
+    }
+
+    MPI_Type_contiguous( 2*m_dim_z, MPI_DOUBLE, &m_row_type );
+    MPI_Type_commit( &m_row_type );
+
+    m_pack = fftw_alloc_complex( m_dim );
+    m_work = fftw_alloc_complex( int64_t(m_dim_x_global)*m_ny[m_rank]*m_dim_z );
+    assert( m_pack != nullptr );
+    assert( m_work != nullptr );
+
+    // y-z planes of the local slab
+    const int n_yz[2] = { m_dim_y, m_dim_z };
+    m_forwardPlan  = fftw_plan_many_dft( 2, n_yz, m_dim_x, m_in, nullptr, 1, m_dim_y*m_dim_z, m_out, nullptr, 1, m_dim_y*m_dim_z, FFTW_FORWARD, Get_Planner_Flags() );
+    m_backwardPlan = fftw_plan_many_dft( 2, n_yz, m_dim_x, m_out, nullptr, 1, m_dim_y*m_dim_z, m_in, nullptr, 1, m_dim_y*m_dim_z, FFTW_BACKWARD, Get_Planner_Flags() );
+
+    // x-axis of the transposed data
+    const int n_x[1] = { m_dim_x_global };
+    const int stride = m_ny[m_rank]*m_dim_z;
+    m_forwardPlan_x  = fftw_plan_many_dft( 1, n_x, stride, m_work, nullptr, stride, 1, m_work, nullptr, stride, 1, FFTW_FORWARD, Get_Planner_Flags() );
+    m_backwardPlan_x = fftw_plan_many_dft( 1, n_x, stride, m_work, nullptr, stride, 1, m_work, nullptr, stride, 1, FFTW_BACKWARD, Get_Planner_Flags() );
+
+    assert( m_forwardPlan != nullptr );
+    assert( m_backwardPlan != nullptr );
+    assert( m_forwardPlan_x != nullptr );
+    assert( m_backwardPlan_x != nullptr );
+  }
+
+  cft_3d_mpi::~cft_3d_mpi()
+  {
+    fftw_destroy_plan( m_forwardPlan_x );
+    fftw_destroy_plan( m_backwardPlan_x );
+    fftw_free( m_pack );
+    fftw_free( m_work );
+    MPI_Type_free( &m_row_type );
+  }
+
+  /**
+   * \brief Header of the x-planes of this process
+   *
+   * @param header Header of the whole grid
+   * @param t Type of the transform
+   */
+  generic_header cft_3d_mpi::Local_Header( const generic_header &header, Fourier::TYPE t )
+  {
+    int rank, no_ranks;
+    MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+    MPI_Comm_size( MPI_COMM_WORLD, &no_ranks );
+
+    if ( t == Fourier::TYPE::REAL ) throw std::string("Error in " + std::string(__func__) + ": r2c transforms are not available for distributed grids\n");
+    if ( header.nDimX < no_ranks || header.nDimY < no_ranks ) throw std::string("Error in " + std::string(__func__) + ": the grid needs at least one x-plane and one y-row per process\n");
+
+    std::vector<int> x0, nx;
+    Split( header.nDimX, no_ranks, x0, nx );
+
+    generic_header retval = header;
+    retval.nDimX = nx[rank];
+    retval.xMin = header.xMin + x0[rank]*header.dx;
+    retval.xMax = retval.xMin + nx[rank]*header.dx;
+    return retval;
+  }
+
+  /**
+   * \brief Block distribution of n points over no_ranks processes
+   *
+   * @param n Number of points
+   * @param no_ranks Number of processes
+   * @param start First point of each process
+   * @param count Number of points of each process
+   */
+  void cft_3d_mpi::Split( const int n, const int no_ranks, std::vector<int> &start, std::vector<int> &count )
+  {
+    start.resize(no_ranks);
+    count.resize(no_ranks);
+    for ( int r=0; r<no_ranks; r++ )
+    {
+      count[r] = n/no_ranks + ( ( r < n%no_ranks ) ? (1) : (0) );
+      start[r] = ( r == 0 ) ? (0) : (start[r-1]+count[r-1]);
+    }
+  }
+
+  /**
+   * \brief Performs Fourier Transformation
+   *
+   * Forward FT (isign = -1) transforms data in m_in --> m_out
+   * Backward FT (isign = 1) transforms data in m_out --> m_in
+   * Both have to be called by all processes.
+   *
+   * @param isign Whether forward [isign = -1] or backward [isign = 1]
+   fourier transformation is performed.
+  */
+  void cft_3d_mpi::ft( int isign )
+  {
+    m_isign = isign;
+    if ( abs(isign) != 1 ) return;
+    if ( isign == -1 )
+    {
+      fftw_execute( m_forwardPlan );
+      transpose( true );
+      fftw_execute( m_forwardPlan_x );
+      transpose( false );
+      scale( m_out, m_dx*m_dy*m_dz/pow(2*M_PI,1.5) );
+    }
+    else
+    {
+      transpose( true );
+      fftw_execute( m_backwardPlan_x );
+      transpose( false );
+      fftw_execute( m_backwardPlan );
+      scale( m_in, m_dkx*m_dky*m_dkz/pow(2*M_PI,1.5) );
+    }
+  }
+
+  /**
+   * \brief Exchange between the x-slabs of m_out and the y-slabs of m_work
+   *
+   * Process r receives the y-rows m_y0[r] ... m_y0[r]+m_ny[r]-1 of all x-planes. The blocks arrive ordered by
+   * the sending process, i.e. by x, so m_work is a [nx][ny_local][nz] array.
+   *
+   * @param to_y true: m_out --> m_work, false: m_work --> m_out
+   */
+  void cft_3d_mpi::transpose( const bool to_y )
+  {
+    const int64_t nz = m_dim_z;
+    std::vector<int> slab_counts(m_no_ranks), slab_displs(m_no_ranks), work_counts(m_no_ranks), work_displs(m_no_ranks);
+    for ( int r=0; r<m_no_ranks; r++ )
+    {
+      slab_counts[r] = m_dim_x*m_ny[r];
+      slab_displs[r] = m_dim_x*m_y0[r];
+      work_counts[r] = m_nx[r]*m_ny[m_rank];
+      work_displs[r] = m_x0[r]*m_ny[m_rank];
+    }
+
+    if ( to_y )
+    {
+      #pragma omp parallel for collapse(2)
+      for ( int r=0; r<m_no_ranks; r++ )
+        for ( int i=0; i<m_dim_x; i++ )
+          std::memcpy( m_pack+(int64_t(slab_displs[r])+int64_t(i)*m_ny[r])*nz, m_out+(int64_t(i)*m_dim_y+m_y0[r])*nz, sizeof(fftw_complex)*m_ny[r]*nz );
+
+      MPI_Alltoallv( m_pack, slab_counts.data(), slab_displs.data(), m_row_type, m_work, work_counts.data(), work_displs.data(), m_row_type, MPI_COMM_WORLD );
+    }
+    else
+    {
+      MPI_Alltoallv( m_work, work_counts.data(), work_displs.data(), m_row_type, m_pack, slab_counts.data(), slab_displs.data(), m_row_type, MPI_COMM_WORLD );
+
+      #pragma omp parallel for collapse(2)
+      for ( int r=0; r<m_no_ranks; r++ )
+        for ( int i=0; i<m_dim_x; i++ )
+          std::memcpy( m_out+(int64_t(i)*m_dim_y+m_y0[r])*nz, m_pack+(int64_t(slab_displs[r])+int64_t(i)*m_ny[r])*nz, sizeof(fftw_complex)*m_ny[r]*nz );
+    }
+  }
+
+  /// Only the FFTW ordering is available
+  void cft_3d_mpi::SetFix( bool bval )
+  {
+    if ( bval ) throw std::string("Error in " + std::string(__func__) + ": the fixed ordering is not available for distributed grids\n");
+  }
+
+  /**
+   * \brief Get x
+   *
+   * @param l Local array index
+   * @returns Coordinates in the whole grid
+   */
+  CPoint<3> cft_3d_mpi::Get_x( const int64_t l )
+  {
+    CPoint<3> retval;
+    int64_t i = l / m_dim_y / m_dim_z;
+    int64_t j = (l - i*m_dim_y*m_dim_z) / m_dim_z;
+    int64_t k = l - i*m_dim_y*m_dim_z - j*m_dim_z;
+    retval[0] = m_x_table[0][i];
+    retval[1] = m_x_table[1][j];
+    retval[2] = m_x_table[2][k];
+    return retval;
+  }
+
+  /**
+   * \brief Get k
+   *
+   * @param l Local array index
+   * @returns Transform variable in the whole grid
+   */
+  CPoint<3> cft_3d_mpi::Get_k( const int64_t l )
+  {
+    CPoint<3> retval;
+    int64_t i = l / m_dim_y / m_dim_z;
+    int64_t j = (l - i*m_dim_y*m_dim_z) / m_dim_z;
+    int64_t k = l - i*m_dim_y*m_dim_z - j*m_dim_z;
+    retval[0] = m_k_table[0][i];
+    retval[1] = m_k_table[1][j];
+    retval[2] = m_k_table[2][k];
+    return retval;
+  }
+
+  /// Index of the first local point in the whole real-space array
+  int64_t cft_3d_mpi::Get_Offset_RS() const
+  {
+    return int64_t(m_x0[m_rank])*m_dim_y*m_dim_z;
+  }
+
+  /// Sum of val over all processes
+  double cft_3d_mpi::Sum( const double val ) const
+  {
+    double retval = 0;
+    MPI_Allreduce( &val, &retval, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
+    return retval;
+  }
+
+  /// Maximum of val over all processes
+  double cft_3d_mpi::Max( const double val ) const
+  {
+    double retval = 0;
+    MPI_Allreduce( &val, &retval, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD );
+    return retval;
+  }
+
+  /**
+   * \brief Collective write of header and data of all processes to a binary file
+   *
+   * The file has the same layout as the one of cft_3d. Rank 0 writes the header, every process its x-planes.
+   *
+   * @param filename Name of the file
+   * @param header Header written in front of the data (whole grid)
+   * @param data Get_Dim_RS() complex values of this process
+   * @param append Append header and data to the file instead of replacing it
+   * @param version File format version (see File_Format)
+   */
+  void cft_3d_mpi::Write_Data( const std::string &filename, const generic_header &header, const fftw_complex *data, const bool append, const int version )
+  {
+    MPI_File fh;
+    if ( MPI_File_open( MPI_COMM_WORLD, const_cast<char *>(filename.c_str()), MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh ) != MPI_SUCCESS )
+      throw std::string("Error in " + std::string(__func__) + ": could not open file " + filename + "\n");
+
+    MPI_Offset base = 0;
+    if ( append )
+    {
+      MPI_File_get_size( fh, &base );
+      MPI_Barrier( MPI_COMM_WORLD );
+    }
+    else
+    {
+      MPI_File_set_size( fh, 0 );
+    }
+
+    const std::vector<char> block = File_Format::Encode( header, version );
+    if ( m_rank == 0 )
+      MPI_File_write_at( fh, base, const_cast<char *>(block.data()), int(block.size()), MPI_BYTE, MPI_STATUS_IGNORE );
+
+    const MPI_Offset offset = base + MPI_Offset(block.size()) + Get_Offset_RS()*sizeof(fftw_complex);
+    MPI_File_write_at_all( fh, offset, const_cast<fftw_complex *>(data), m_dim_x*m_dim_y, m_row_type, MPI_STATUS_IGNORE );
+
+    // Pad the frame, the next one has to start aligned as well
+    const MPI_Offset alignment = MPI_Offset(File_Format::Alignment(version));
+    const MPI_Offset end = base + MPI_Offset(block.size() + File_Format::Data_Size(header));
+    if ( alignment > 1 )
+      MPI_File_set_size( fh, (end + alignment - 1)/alignment*alignment );
+    MPI_File_close( &fh );
+  }
+
+  /**
+   * \brief Multiplies the local data by fak
+   */
+  void cft_3d_mpi::scale( fftw_complex *data, const double fak )
+  {
+    #pragma omp parallel for
+    for ( int64_t t=0; t<m_no_tiles; t++ )
+    {
+      const grid_tile tile = Get_Tile(t);
+      Kernels::Scale( data+tile.l0, fak, tile.n );
+    }
+  }
+}
@@ -0,0 +1,146 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+/** Compares the slab-decomposed transform (cft_3d_mpi) with the serial one (cft_3d)
+  *
+  * Usage: mpirun -np 4 check_mpi_fft [nx ny nz]
+  *
+  * Every process transforms the whole grid with cft_3d and its x-planes with cft_3d_mpi, forward and back,
+  * and compares its planes. The default grid 30 x 28 x 16 does not split evenly over 4 processes, so uneven
+  * slabs are covered as well. Returns EXIT_FAILURE if the largest deviation exceeds 1e-10.
+  */
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <mpi.h>
+#include "fftw3.h"
+#include "my_structs.h"
+#include "cft_3d.h"
+#include "cft_3d_mpi.h"
+
+namespace
+{
+  const double TOLERANCE = 1e-10;
+
+  /// Gaussian with a phase, not symmetric in any direction
+  void Fill( fftw_complex *data, const int64_t n, const int64_t offset, const generic_header &header )
+  {
+    const int64_t nyz = header.nDimY*header.nDimZ;
+    for ( int64_t l=0; l<n; l++ )
+    {
+      const int64_t gl = offset + l;
+      const double x = header.xMin + double(gl/nyz)*header.dx;
+      const double y = header.yMin + double((gl/header.nDimZ)%header.nDimY)*header.dy;
+      const double z = header.zMin + double(gl%header.nDimZ)*header.dz;
+      const double r2 = (x-0.3)*(x-0.3) + 2*(y+0.1)*(y+0.1) + 0.5*z*z;
+      const double phi = 1.3*x - 0.7*y + 0.2*z*z;
+      data[l][0] = exp(-r2)*cos(phi);
+      data[l][1] = exp(-r2)*sin(phi);
+    }
+  }
+
+  double Max_Deviation( const fftw_complex *a, const fftw_complex *b, const int64_t n )
+  {
+    double retval = 0;
+    for ( int64_t l=0; l<n; l++ )
+      retval = std::max( retval, std::hypot( a[l][0]-b[l][0], a[l][1]-b[l][1] ) );
+    return retval;
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  int provided, rank, no_ranks;
+  MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &provided );
+  MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+  MPI_Comm_size( MPI_COMM_WORLD, &no_ranks );
+  if ( provided < MPI_THREAD_FUNNELED )
+  {
+    if ( rank == 0 ) std::cerr << "Error: the MPI library does not provide MPI_THREAD_FUNNELED\n";
+    MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+  }
+
+  int retval = EXIT_SUCCESS;
+  try
+  {
+    generic_header header = {};
+    header.nDims = 3;
+    header.nself = sizeof(generic_header);
+    header.nDatatyp = sizeof(fftw_complex);
+    header.bComplex = 1;
+    header.nDimX = ( argc == 4 ) ? (std::stoi(argv[1])) : (30);
+    header.nDimY = ( argc == 4 ) ? (std::stoi(argv[2])) : (28);
+    header.nDimZ = ( argc == 4 ) ? (std::stoi(argv[3])) : (16);
+    header.xMin = -4; header.xMax = 4;
+    header.yMin = -4; header.yMax = 4;
+    header.zMin = -5; header.zMax = 5;
+    header.dx = (header.xMax-header.xMin)/double(header.nDimX);
+    header.dy = (header.yMax-header.yMin)/double(header.nDimY);
+    header.dz = (header.zMax-header.zMin)/double(header.nDimZ);
+    header.dkx = 2*M_PI/(header.xMax-header.xMin);
+    header.dky = 2*M_PI/(header.yMax-header.yMin);
+    header.dkz = 2*M_PI/(header.zMax-header.zMin);
+
+    Fourier::cft_3d serial( header );
+    serial.SetFix(false);
+    Fourier::cft_3d_mpi distributed( header );
+
+    const int64_t n = distributed.Get_Dim_RS();
+    const int64_t offset = distributed.Get_Offset_RS();
+    Fill( serial.Getp2In(), serial.Get_Dim_RS(), 0, header );
+    // cft_3d_mpi holds the planes of this process only, shift the fill to the global index
+    Fill( distributed.Getp2In(), n, offset, header );
+
+    serial.ft(-1);
+    distributed.ft(-1);
+    double dev[2];
+    dev[0] = Max_Deviation( serial.Getp2Out()+offset, distributed.Getp2Out(), n );
+
+    serial.ft(1);
+    distributed.ft(1);
+    dev[1] = Max_Deviation( serial.Getp2In()+offset, distributed.Getp2In(), n );
+
+    double max_dev[2];
+    MPI_Allreduce( dev, max_dev, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD );
+    if ( rank == 0 )
+    {
+      std::cout << "grid " << header.nDimX << " x " << header.nDimY << " x " << header.nDimZ << ", " << no_ranks << " processes\n";
+      std::cout << "forward  : max |serial - distributed| = " << max_dev[0] << "\n";
+      std::cout << "backward : max |serial - distributed| = " << max_dev[1] << "\n";
+    }
+    if ( max_dev[0] > TOLERANCE || max_dev[1] > TOLERANCE )
+    {
+      if ( rank == 0 ) std::cout << "FAILED\n";
+      retval = EXIT_FAILURE;
+    }
+    else if ( rank == 0 )
+    {
+      std::cout << "PASSED\n";
+    }
+  }
+  catch ( const std::string &str )
+  {
+    std::cerr << str;
+    MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+  }
+
+  MPI_Finalize();
+  return retval;
+}
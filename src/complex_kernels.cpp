@@ -0,0 +1,768 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "complex_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TALISES_X86
+#include <immintrin.h>
+#endif
+
+namespace Kernels
+{
+  namespace
+  {
+    /// Number of phases converted per batch in Multiply_Phase
+    const int PHASE_BATCH = 256;
+
+    SIMD_LEVEL Detect_SIMD_Level()
+    {
+#ifdef TALISES_X86
+      __builtin_cpu_init();
+      if ( __builtin_cpu_supports("avx512f") ) return AVX512;
+      if ( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ) return AVX2;
+#endif
+      return GENERIC;
+    }
+
+    const SIMD_LEVEL max_level = Detect_SIMD_Level();
+    SIMD_LEVEL level = max_level;
+
+    /*
+     * Constants of the vectorized sincos. The argument is reduced to r = x - q pi/2, |r| <= pi/4, with a
+     * three-part Cody-Waite splitting of pi/2 and evaluated with the minimax polynomials of fdlibm.
+     */
+    const double SC_MAGIC = 6755399441055744.0; // 1.5*2^52, rounds to integer and leaves q in the low bits
+    const double SC_2_PI = 0.6366197723675814;
+    const double SC_PIO2_1 = 1.5707963267948966;
+    const double SC_PIO2_2 = 6.123233995736766e-17;
+    const double SC_PIO2_3 = -1.4973849048591698e-33;
+    const double SC_MAX_ARG = 1073741824.0; // 2^30, larger arguments are passed to libm
+    const double S1 = -1.66666666666666324348e-01;
+    const double S2 = 8.33333333332248946124e-03;
+    const double S3 = -1.98412698298579493134e-04;
+    const double S4 = 2.75573137070700676789e-06;
+    const double S5 = -2.50507602534068634195e-08;
+    const double S6 = 1.58969099521155010221e-10;
+    const double C1 = 4.16666666666666019037e-02;
+    const double C2 = -1.38888888888741095749e-03;
+    const double C3 = 2.48015872894767294178e-05;
+    const double C4 = -2.75573143513906633035e-07;
+    const double C5 = 2.08757232129817482790e-09;
+    const double C6 = -1.13596475577881948265e-11;
+
+    /// Maximum absolute error of the polynomial sincos in units of 2^-52
+    const double SC_POLY_ULP = 1.0;
+    /// Growth of the absolute error per step of the rotation recurrence in units of 2^-52
+    const double SC_ROTATION_ULP = 2.0;
+    /// Maximum number of steps of the rotation recurrence between two exact evaluations
+    const int64_t SC_MAX_ROTATIONS = 256;
+
+    double sincos_ulp = 4;
+
+    /*
+     * Generic versions
+     */
+    void Multiply_generic( double *a, const double *b, const int64_t n )
+    {
+      for ( int64_t l=0; l<2*n; l+=2 )
+      {
+        const double re = a[l]*b[l] - a[l+1]*b[l+1];
+        const double im = a[l+1]*b[l] + a[l]*b[l+1];
+        a[l] = re;
+        a[l+1] = im;
+      }
+    }
+
+    void Multiply_Conj_generic( double *a, const double *b, const int64_t n )
+    {
+      for ( int64_t l=0; l<2*n; l+=2 )
+      {
+        const double re = a[l]*b[l] + a[l+1]*b[l+1];
+        const double im = a[l+1]*b[l] - a[l]*b[l+1];
+        a[l] = re;
+        a[l+1] = im;
+      }
+    }
+
+    void Multiply_Const_generic( double *a, const double re, const double im, const int64_t n )
+    {
+      for ( int64_t l=0; l<2*n; l+=2 )
+      {
+        const double tmp = a[l];
+        a[l] = a[l]*re - a[l+1]*im;
+        a[l+1] = a[l+1]*re + tmp*im;
+      }
+    }
+
+    void Scale_generic( double *a, const double fak, const int64_t n )
+    {
+      for ( int64_t l=0; l<2*n; l++ )
+        a[l] *= fak;
+    }
+
+    void Swap_Scale_Alternating_generic( double *a, double *b, const double fak_a, const double fak_b, const int64_t n )
+    {
+      for ( int64_t l=0; l<n; l++ )
+      {
+        const double fa = ( l%2 == 1 ) ? (-fak_a) : (fak_a);
+        const double fb = ( l%2 == 1 ) ? (-fak_b) : (fak_b);
+        const double re = a[2*l];
+        const double im = a[2*l+1];
+        a[2*l] = b[2*l]*fa;
+        a[2*l+1] = b[2*l+1]*fa;
+        b[2*l] = re*fb;
+        b[2*l+1] = im*fb;
+      }
+    }
+
+    double Norm2_generic( const double *a, const int64_t n )
+    {
+      double retval = 0;
+      for ( int64_t l=0; l<2*n; l++ )
+        retval += a[l]*a[l];
+      return retval;
+    }
+
+    /// e[l] = (cos(phi[l]),sin(phi[l])) with libm
+    void Exp_Phase_libm( const double *phi, double *e, const int64_t n )
+    {
+      for ( int64_t l=0; l<n; l++ )
+        sincos( phi[l], &e[2*l+1], &e[2*l] );
+    }
+
+    /// Passes arguments outside of the range of the argument reduction to libm
+    void Exp_Phase_Fixup( const double *phi, double *e, const int64_t n )
+    {
+      for ( int64_t l=0; l<n; l++ )
+        if ( !(std::fabs(phi[l]) <= SC_MAX_ARG) )
+          sincos( phi[l], &e[2*l+1], &e[2*l] );
+    }
+
+    void Exp_Phase_generic( const double *phi, double *e, const int64_t n )
+    {
+      bool large = false;
+      #pragma omp simd reduction(||:large)
+      for ( int64_t l=0; l<n; l++ )
+      {
+        const double x = phi[l];
+        large = large || !(std::fabs(x) <= SC_MAX_ARG);
+
+        const double t = std::fma( x, SC_2_PI, SC_MAGIC );
+        const double q = t - SC_MAGIC;
+        int64_t iq;
+        std::memcpy( &iq, &t, sizeof(double) );
+
+        double r = std::fma( -q, SC_PIO2_1, x );
+        r = std::fma( -q, SC_PIO2_2, r );
+        r = std::fma( -q, SC_PIO2_3, r );
+
+        const double z = r*r;
+        const double sin_r = r + z*r*(S1 + z*(S2 + z*(S3 + z*(S4 + z*(S5 + z*S6)))));
+        const double hz = 0.5*z;
+        const double w = 1.0 - hz;
+        const double cos_r = w + (((1.0-w)-hz) + z*z*(C1 + z*(C2 + z*(C3 + z*(C4 + z*(C5 + z*C6))))));
+
+        const bool swap = (iq & 1) != 0;
+        double sn = swap ? cos_r : sin_r;
+        double cs = swap ? sin_r : cos_r;
+        sn = ( iq & 2 ) ? -sn : sn;
+        cs = ( (iq+1) & 2 ) ? -cs : cs;
+        e[2*l] = cs;
+        e[2*l+1] = sn;
+      }
+      if ( large ) Exp_Phase_Fixup( phi, e, n );
+    }
+
+#ifdef TALISES_X86
+    /*
+     * AVX2 versions, 2 complex numbers per register
+     */
+    __attribute__((target("avx2,fma")))
+    void Multiply_avx2( double *a, const double *b, const int64_t n )
+    {
+      int64_t l=0;
+      for ( ; l+2<=n; l+=2 )
+      {
+        const __m256d x = _mm256_loadu_pd(a+2*l);
+        const __m256d y = _mm256_loadu_pd(b+2*l);
+        const __m256d y_re = _mm256_movedup_pd(y);
+        const __m256d y_im = _mm256_permute_pd(y,0xF);
+        const __m256d x_sw = _mm256_permute_pd(x,0x5);
+        _mm256_storeu_pd( a+2*l, _mm256_fmaddsub_pd(x,y_re,_mm256_mul_pd(x_sw,y_im)) );
+      }
+      Multiply_generic( a+2*l, b+2*l, n-l );
+    }
+
+    __attribute__((target("avx2,fma")))
+    void Multiply_Conj_avx2( double *a, const double *b, const int64_t n )
+    {
+      int64_t l=0;
+      for ( ; l+2<=n; l+=2 )
+      {
+        const __m256d x = _mm256_loadu_pd(a+2*l);
+        const __m256d y = _mm256_loadu_pd(b+2*l);
+        const __m256d y_re = _mm256_movedup_pd(y);
+        const __m256d y_im = _mm256_permute_pd(y,0xF);
+        const __m256d x_sw = _mm256_permute_pd(x,0x5);
+        _mm256_storeu_pd( a+2*l, _mm256_fmsubadd_pd(x,y_re,_mm256_mul_pd(x_sw,y_im)) );
+      }
+      Multiply_Conj_generic( a+2*l, b+2*l, n-l );
+    }
+
+    __attribute__((target("avx2,fma")))
+    void Multiply_Const_avx2( double *a, const double re, const double im, const int64_t n )
+    {
+      const __m256d y_re = _mm256_set1_pd(re);
+      const __m256d y_im = _mm256_set1_pd(im);
+      int64_t l=0;
+      for ( ; l+2<=n; l+=2 )
+      {
+        const __m256d x = _mm256_loadu_pd(a+2*l);
+        const __m256d x_sw = _mm256_permute_pd(x,0x5);
+        _mm256_storeu_pd( a+2*l, _mm256_fmaddsub_pd(x,y_re,_mm256_mul_pd(x_sw,y_im)) );
+      }
+      Multiply_Const_generic( a+2*l, re, im, n-l );
+    }
+
+    __attribute__((target("avx2,fma")))
+    void Scale_avx2( double *a, const double fak, const int64_t n )
+    {
+      const __m256d f = _mm256_set1_pd(fak);
+      int64_t l=0;
+      for ( ; l+2<=n; l+=2 )
+        _mm256_storeu_pd( a+2*l, _mm256_mul_pd(_mm256_loadu_pd(a+2*l),f) );
+      Scale_generic( a+2*l, fak, n-l );
+    }
+
+    __attribute__((target("avx2,fma")))
+    void Swap_Scale_Alternating_avx2( double *a, double *b, const double fak_a, const double fak_b, const int64_t n )
+    {
+      const __m256d fa = _mm256_setr_pd(fak_a,fak_a,-fak_a,-fak_a);
+      const __m256d fb = _mm256_setr_pd(fak_b,fak_b,-fak_b,-fak_b);
+      int64_t l=0;
+      for ( ; l+2<=n; l+=2 )
+      {
+        const __m256d x = _mm256_loadu_pd(a+2*l);
+        const __m256d y = _mm256_loadu_pd(b+2*l);
+        _mm256_storeu_pd( a+2*l, _mm256_mul_pd(y,fa) );
+        _mm256_storeu_pd( b+2*l, _mm256_mul_pd(x,fb) );
+      }
+      Swap_Scale_Alternating_generic( a+2*l, b+2*l, fak_a, fak_b, n-l );
+    }
+
+    __attribute__((target("avx2,fma")))
+    double Norm2_avx2( const double *a, const int64_t n )
+    {
+      __m256d s0 = _mm256_setzero_pd();
+      __m256d s1 = _mm256_setzero_pd();
+      int64_t l=0;
+      for ( ; l+4<=n; l+=4 )
+      {
+        const __m256d x0 = _mm256_loadu_pd(a+2*l);
+        const __m256d x1 = _mm256_loadu_pd(a+2*l+4);
+        s0 = _mm256_fmadd_pd(x0,x0,s0);
+        s1 = _mm256_fmadd_pd(x1,x1,s1);
+      }
+      s0 = _mm256_add_pd(s0,s1);
+      const __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s0),_mm256_extractf128_pd(s0,1));
+      return _mm_cvtsd_f64(_mm_add_sd(h,_mm_unpackhi_pd(h,h))) + Norm2_generic( a+2*l, n-l );
+    }
+
+    __attribute__((target("avx2,fma")))
+    void Exp_Phase_avx2( const double *phi, double *e, const int64_t n )
+    {
+      const __m256d sign = _mm256_set1_pd(-0.0);
+      const __m256d max_arg = _mm256_set1_pd(SC_MAX_ARG);
+      const __m256i one = _mm256_set1_epi64x(1);
+      const __m256i two = _mm256_set1_epi64x(2);
+      __m256d large = _mm256_setzero_pd();
+
+      int64_t l=0;
+      for ( ; l+4<=n; l+=4 )
+      {
+        const __m256d x = _mm256_loadu_pd(phi+l);
+        large = _mm256_or_pd( large, _mm256_cmp_pd(_mm256_andnot_pd(sign,x),max_arg,_CMP_NLE_UQ) );
+
+        const __m256d t = _mm256_fmadd_pd( x, _mm256_set1_pd(SC_2_PI), _mm256_set1_pd(SC_MAGIC) );
+        const __m256d q = _mm256_sub_pd( t, _mm256_set1_pd(SC_MAGIC) );
+        const __m256i iq = _mm256_castpd_si256(t);
+
+        __m256d r = _mm256_fnmadd_pd( q, _mm256_set1_pd(SC_PIO2_1), x );
+        r = _mm256_fnmadd_pd( q, _mm256_set1_pd(SC_PIO2_2), r );
+        r = _mm256_fnmadd_pd( q, _mm256_set1_pd(SC_PIO2_3), r );
+
+        const __m256d z = _mm256_mul_pd(r,r);
+        __m256d ps = _mm256_fmadd_pd( z, _mm256_set1_pd(S6), _mm256_set1_pd(S5) );
+        ps = _mm256_fmadd_pd( z, ps, _mm256_set1_pd(S4) );
+        ps = _mm256_fmadd_pd( z, ps, _mm256_set1_pd(S3) );
+        ps = _mm256_fmadd_pd( z, ps, _mm256_set1_pd(S2) );
+        ps = _mm256_fmadd_pd( z, ps, _mm256_set1_pd(S1) );
+        const __m256d sin_r = _mm256_fmadd_pd( _mm256_mul_pd(z,r), ps, r );
+
+        __m256d pc = _mm256_fmadd_pd( z, _mm256_set1_pd(C6), _mm256_set1_pd(C5) );
+        pc = _mm256_fmadd_pd( z, pc, _mm256_set1_pd(C4) );
+        pc = _mm256_fmadd_pd( z, pc, _mm256_set1_pd(C3) );
+        pc = _mm256_fmadd_pd( z, pc, _mm256_set1_pd(C2) );
+        pc = _mm256_fmadd_pd( z, pc, _mm256_set1_pd(C1) );
+        const __m256d hz = _mm256_mul_pd( _mm256_set1_pd(0.5), z );
+        const __m256d w = _mm256_sub_pd( _mm256_set1_pd(1.0), hz );
+        const __m256d corr = _mm256_sub_pd( _mm256_sub_pd(_mm256_set1_pd(1.0),w), hz );
+        const __m256d cos_r = _mm256_add_pd( w, _mm256_fmadd_pd(_mm256_mul_pd(z,z),pc,corr) );
+
+        const __m256d swap = _mm256_castsi256_pd( _mm256_cmpeq_epi64(_mm256_and_si256(iq,one),one) );
+        __m256d sn = _mm256_blendv_pd( sin_r, cos_r, swap );
+        __m256d cs = _mm256_blendv_pd( cos_r, sin_r, swap );
+        sn = _mm256_xor_pd( sn, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(iq,two),62)) );
+        cs = _mm256_xor_pd( cs, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(iq,one),two),62)) );
+
+        const __m256d lo = _mm256_unpacklo_pd(cs,sn);
+        const __m256d hi = _mm256_unpackhi_pd(cs,sn);
+        _mm256_storeu_pd( e+2*l, _mm256_permute2f128_pd(lo,hi,0x20) );
+        _mm256_storeu_pd( e+2*l+4, _mm256_permute2f128_pd(lo,hi,0x31) );
+      }
+      Exp_Phase_generic( phi+l, e+2*l, n-l );
+      if ( _mm256_movemask_pd(large) != 0 ) Exp_Phase_Fixup( phi, e, l );
+    }
+
+    /*
+     * AVX-512 versions, 4 complex numbers per register, masked remainders
+     */
+    __attribute__((target("avx512f")))
+    inline __mmask8 Tail_Mask( const int64_t n )
+    {
+      return __mmask8( (1u << (2*n)) - 1 );
+    }
+
+    __attribute__((target("avx512f")))
+    inline __m512d Multiply_avx512( const __m512d x, const __m512d y )
+    {
+      const __m512d y_re = _mm512_movedup_pd(y);
+      const __m512d y_im = _mm512_permute_pd(y,0xFF);
+      const __m512d x_sw = _mm512_permute_pd(x,0x55);
+      return _mm512_fmaddsub_pd(x,y_re,_mm512_mul_pd(x_sw,y_im));
+    }
+
+    __attribute__((target("avx512f")))
+    inline __m512d Multiply_Conj_avx512( const __m512d x, const __m512d y )
+    {
+      const __m512d y_re = _mm512_movedup_pd(y);
+      const __m512d y_im = _mm512_permute_pd(y,0xFF);
+      const __m512d x_sw = _mm512_permute_pd(x,0x55);
+      return _mm512_fmsubadd_pd(x,y_re,_mm512_mul_pd(x_sw,y_im));
+    }
+
+    __attribute__((target("avx512f")))
+    void Multiply_avx512( double *a, const double *b, const int64_t n )
+    {
+      int64_t l=0;
+      for ( ; l+4<=n; l+=4 )
+        _mm512_storeu_pd( a+2*l, Multiply_avx512(_mm512_loadu_pd(a+2*l),_mm512_loadu_pd(b+2*l)) );
+      if ( l < n )
+      {
+        const __mmask8 m = Tail_Mask(n-l);
+        const __m512d x = _mm512_maskz_loadu_pd(m,a+2*l);
+        const __m512d y = _mm512_maskz_loadu_pd(m,b+2*l);
+        _mm512_mask_storeu_pd( a+2*l, m, Multiply_avx512(x,y) );
+      }
+    }
+
+    __attribute__((target("avx512f")))
+    void Multiply_Conj_avx512( double *a, const double *b, const int64_t n )
+    {
+      int64_t l=0;
+      for ( ; l+4<=n; l+=4 )
+        _mm512_storeu_pd( a+2*l, Multiply_Conj_avx512(_mm512_loadu_pd(a+2*l),_mm512_loadu_pd(b+2*l)) );
+      if ( l < n )
+      {
+        const __mmask8 m = Tail_Mask(n-l);
+        const __m512d x = _mm512_maskz_loadu_pd(m,a+2*l);
+        const __m512d y = _mm512_maskz_loadu_pd(m,b+2*l);
+        _mm512_mask_storeu_pd( a+2*l, m, Multiply_Conj_avx512(x,y) );
+      }
+    }
+
+    __attribute__((target("avx512f")))
+    void Multiply_Const_avx512( double *a, const double re, const double im, const int64_t n )
+    {
+      const __m512d y = _mm512_setr_pd(re,im,re,im,re,im,re,im);
+      int64_t l=0;
+      for ( ; l+4<=n; l+=4 )
+        _mm512_storeu_pd( a+2*l, Multiply_avx512(_mm512_loadu_pd(a+2*l),y) );
+      if ( l < n )
+      {
+        const __mmask8 m = Tail_Mask(n-l);
+        _mm512_mask_storeu_pd( a+2*l, m, Multiply_avx512(_mm512_maskz_loadu_pd(m,a+2*l),y) );
+      }
+    }
+
+    __attribute__((target("avx512f")))
+    void Scale_avx512( double *a, const double fak, const int64_t n )
+    {
+      const __m512d f = _mm512_set1_pd(fak);
+      int64_t l=0;
+      for ( ; l+4<=n; l+=4 )
+        _mm512_storeu_pd( a+2*l, _mm512_mul_pd(_mm512_loadu_pd(a+2*l),f) );
+      if ( l < n )
+      {
+        const __mmask8 m = Tail_Mask(n-l);
+        _mm512_mask_storeu_pd( a+2*l, m, _mm512_mul_pd(_mm512_maskz_loadu_pd(m,a+2*l),f) );
+      }
+    }
+
+    __attribute__((target("avx512f")))
+    void Swap_Scale_Alternating_avx512( double *a, double *b, const double fak_a, const double fak_b, const int64_t n )
+    {
+      const __m512d fa = _mm512_setr_pd(fak_a,fak_a,-fak_a,-fak_a,fak_a,fak_a,-fak_a,-fak_a);
+      const __m512d fb = _mm512_setr_pd(fak_b,fak_b,-fak_b,-fak_b,fak_b,fak_b,-fak_b,-fak_b);
+      int64_t l=0;
+      for ( ; l+4<=n; l+=4 )
+      {
+        const __m512d x = _mm512_loadu_pd(a+2*l);
+        const __m512d y = _mm512_loadu_pd(b+2*l);
+        _mm512_storeu_pd( a+2*l, _mm512_mul_pd(y,fa) );
+        _mm512_storeu_pd( b+2*l, _mm512_mul_pd(x,fb) );
+      }
+      if ( l < n )
+      {
+        const __mmask8 m = Tail_Mask(n-l);
+        const __m512d x = _mm512_maskz_loadu_pd(m,a+2*l);
+        const __m512d y = _mm512_maskz_loadu_pd(m,b+2*l);
+        _mm512_mask_storeu_pd( a+2*l, m, _mm512_mul_pd(y,fa) );
+        _mm512_mask_storeu_pd( b+2*l, m, _mm512_mul_pd(x,fb) );
+      }
+    }
+
+    __attribute__((target("avx512f")))
+    double Norm2_avx512( const double *a, const int64_t n )
+    {
+      __m512d s0 = _mm512_setzero_pd();
+      __m512d s1 = _mm512_setzero_pd();
+      int64_t l=0;
+      for ( ; l+8<=n; l+=8 )
+      {
+        const __m512d x0 = _mm512_loadu_pd(a+2*l);
+        const __m512d x1 = _mm512_loadu_pd(a+2*l+8);
+        s0 = _mm512_fmadd_pd(x0,x0,s0);
+        s1 = _mm512_fmadd_pd(x1,x1,s1);
+      }
+      for ( ; l+4<=n; l+=4 )
+      {
+        const __m512d x0 = _mm512_loadu_pd(a+2*l);
+        s0 = _mm512_fmadd_pd(x0,x0,s0);
+      }
+      if ( l < n )
+      {
+        const __m512d x0 = _mm512_maskz_loadu_pd(Tail_Mask(n-l),a+2*l);
+        s1 = _mm512_fmadd_pd(x0,x0,s1);
+      }
+      return _mm512_reduce_add_pd(_mm512_add_pd(s0,s1));
+    }
+
+    __attribute__((target("avx512f")))
+    void Exp_Phase_avx512( const double *phi, double *e, const int64_t n )
+    {
+      const __m512d max_arg = _mm512_set1_pd(SC_MAX_ARG);
+      const __m512i one = _mm512_set1_epi64(1);
+      const __m512i two = _mm512_set1_epi64(2);
+      const __m512i perm_lo = _mm512_setr_epi64(0,1,8,9,2,3,10,11);
+      const __m512i perm_hi = _mm512_setr_epi64(4,5,12,13,6,7,14,15);
+      __mmask8 large = 0;
+
+      for ( int64_t l=0; l<n; l+=8 )
+      {
+        const __mmask8 m = ( n-l >= 8 ) ? (__mmask8(0xFF)) : (__mmask8((1u << (n-l)) - 1));
+        const __m512d x = _mm512_maskz_loadu_pd(m,phi+l);
+        large |= _mm512_mask_cmp_pd_mask( m, _mm512_abs_pd(x), max_arg, _CMP_NLE_UQ );
+
+        const __m512d t = _mm512_fmadd_pd( x, _mm512_set1_pd(SC_2_PI), _mm512_set1_pd(SC_MAGIC) );
+        const __m512d q = _mm512_sub_pd( t, _mm512_set1_pd(SC_MAGIC) );
+        const __m512i iq = _mm512_castpd_si512(t);
+
+        __m512d r = _mm512_fnmadd_pd( q, _mm512_set1_pd(SC_PIO2_1), x );
+        r = _mm512_fnmadd_pd( q, _mm512_set1_pd(SC_PIO2_2), r );
+        r = _mm512_fnmadd_pd( q, _mm512_set1_pd(SC_PIO2_3), r );
+
+        const __m512d z = _mm512_mul_pd(r,r);
+        __m512d ps = _mm512_fmadd_pd( z, _mm512_set1_pd(S6), _mm512_set1_pd(S5) );
+        ps = _mm512_fmadd_pd( z, ps, _mm512_set1_pd(S4) );
+        ps = _mm512_fmadd_pd( z, ps, _mm512_set1_pd(S3) );
+        ps = _mm512_fmadd_pd( z, ps, _mm512_set1_pd(S2) );
+        ps = _mm512_fmadd_pd( z, ps, _mm512_set1_pd(S1) );
+        const __m512d sin_r = _mm512_fmadd_pd( _mm512_mul_pd(z,r), ps, r );
+
+        __m512d pc = _mm512_fmadd_pd( z, _mm512_set1_pd(C6), _mm512_set1_pd(C5) );
+        pc = _mm512_fmadd_pd( z, pc, _mm512_set1_pd(C4) );
+        pc = _mm512_fmadd_pd( z, pc, _mm512_set1_pd(C3) );
+        pc = _mm512_fmadd_pd( z, pc, _mm512_set1_pd(C2) );
+        pc = _mm512_fmadd_pd( z, pc, _mm512_set1_pd(C1) );
+        const __m512d hz = _mm512_mul_pd( _mm512_set1_pd(0.5), z );
+        const __m512d w = _mm512_sub_pd( _mm512_set1_pd(1.0), hz );
+        const __m512d corr = _mm512_sub_pd( _mm512_sub_pd(_mm512_set1_pd(1.0),w), hz );
+        const __m512d cos_r = _mm512_add_pd( w, _mm512_fmadd_pd(_mm512_mul_pd(z,z),pc,corr) );
+
+        const __mmask8 swap = _mm512_test_epi64_mask( iq, one );
+        __m512d sn = _mm512_mask_blend_pd( swap, sin_r, cos_r );
+        __m512d cs = _mm512_mask_blend_pd( swap, cos_r, sin_r );
+        sn = _mm512_castsi512_pd( _mm512_xor_si512(_mm512_castpd_si512(sn),_mm512_slli_epi64(_mm512_and_si512(iq,two),62)) );
+        cs = _mm512_castsi512_pd( _mm512_xor_si512(_mm512_castpd_si512(cs),_mm512_slli_epi64(_mm512_and_si512(_mm512_add_epi64(iq,one),two),62)) );
+
+        const __m512d lo = _mm512_unpacklo_pd(cs,sn);
+        const __m512d hi = _mm512_unpackhi_pd(cs,sn);
+        const __m512d e_lo = _mm512_permutex2var_pd(lo,perm_lo,hi);
+        const __m512d e_hi = _mm512_permutex2var_pd(lo,perm_hi,hi);
+        if ( m == 0xFF )
+        {
+          _mm512_storeu_pd( e+2*l, e_lo );
+          _mm512_storeu_pd( e+2*l+8, e_hi );
+        }
+        else
+        {
+          const int64_t rest = n-l;
+          _mm512_mask_storeu_pd( e+2*l, Tail_Mask( rest < 4 ? rest : 4 ), e_lo );
+          if ( rest > 4 ) _mm512_mask_storeu_pd( e+2*l+8, Tail_Mask(rest-4), e_hi );
+        }
+      }
+      if ( large != 0 ) Exp_Phase_Fixup( phi, e, n );
+    }
+#endif
+  } // end of anonymous namespace
+
+  /// Highest SIMD level supported by the CPU
+  SIMD_LEVEL Get_Max_SIMD_Level()
+  {
+    return max_level;
+  }
+
+  /// SIMD level used by the kernels
+  SIMD_LEVEL Get_SIMD_Level()
+  {
+    return level;
+  }
+
+  /** Select the SIMD level of the kernels
+    *
+    * @param l Requested level, it is lowered to Get_Max_SIMD_Level() if the CPU does not support it
+    */
+  void Set_SIMD_Level( const SIMD_LEVEL l )
+  {
+    level = ( l > max_level ) ? (max_level) : (l);
+  }
+
+  /** Select the SIMD level of the kernels by name
+    *
+    * @param name One of "generic", "avx2" or "avx512"
+    */
+  void Set_SIMD_Level( const std::string &name )
+  {
+    if ( name == "generic" ) Set_SIMD_Level(GENERIC);
+    else if ( name == "avx2" ) Set_SIMD_Level(AVX2);
+    else if ( name == "avx512" ) Set_SIMD_Level(AVX512);
+    else throw std::string("Error in " + std::string(__func__) + ": unknown SIMD level " + name + "\n");
+  }
+
+  /// Name of a SIMD level
+  std::string Get_SIMD_Name( const SIMD_LEVEL l )
+  {
+    switch( l )
+    {
+      case AVX512: return "avx512";
+      case AVX2: return "avx2";
+      default: return "generic";
+    }
+  }
+
+  void Multiply( fftw_complex *data, const fftw_complex *fak, const int64_t n )
+  {
+    double *a = reinterpret_cast<double *>(data);
+    const double *b = reinterpret_cast<const double *>(fak);
+#ifdef TALISES_X86
+    if ( level == AVX512 ) { Multiply_avx512( a, b, n ); return; }
+    if ( level == AVX2 ) { Multiply_avx2( a, b, n ); return; }
+#endif
+    Multiply_generic( a, b, n );
+  }
+
+  void Multiply_Conj( fftw_complex *data, const fftw_complex *fak, const int64_t n )
+  {
+    double *a = reinterpret_cast<double *>(data);
+    const double *b = reinterpret_cast<const double *>(fak);
+#ifdef TALISES_X86
+    if ( level == AVX512 ) { Multiply_Conj_avx512( a, b, n ); return; }
+    if ( level == AVX2 ) { Multiply_Conj_avx2( a, b, n ); return; }
+#endif
+    Multiply_Conj_generic( a, b, n );
+  }
+
+  void Multiply_Const( fftw_complex *data, const double re, const double im, const int64_t n )
+  {
+    double *a = reinterpret_cast<double *>(data);
+#ifdef TALISES_X86
+    if ( level == AVX512 ) { Multiply_Const_avx512( a, re, im, n ); return; }
+    if ( level == AVX2 ) { Multiply_Const_avx2( a, re, im, n ); return; }
+#endif
+    Multiply_Const_generic( a, re, im, n );
+  }
+
+  /// Maximum absolute error of exp(i phi) in units of 2^-52 allowed for the phase kernels
+  double Get_Sincos_ULP()
+  {
+    return sincos_ulp;
+  }
+
+  /** Select the accuracy of the phase kernels
+    *
+    * The error is measured as absolute error of the components of exp(i phi) in units of 2^-52. Below the
+    * accuracy of the vectorized polynomial (about 1) the phases are computed with libm. Larger tolerances allow
+    * Exp_Linear_Phase() to replace more evaluations by the rotation recurrence.
+    * @param ulp Tolerance
+    */
+  void Set_Sincos_ULP( const double ulp )
+  {
+    sincos_ulp = ulp;
+  }
+
+  void Exp_Phase( const double *phi, fftw_complex *e, const int64_t n )
+  {
+    double *a = reinterpret_cast<double *>(e);
+    if ( sincos_ulp < SC_POLY_ULP ) { Exp_Phase_libm( phi, a, n ); return; }
+#ifdef TALISES_X86
+    if ( level == AVX512 ) { Exp_Phase_avx512( phi, a, n ); return; }
+    if ( level == AVX2 ) { Exp_Phase_avx2( phi, a, n ); return; }
+#endif
+    Exp_Phase_generic( phi, a, n );
+  }
+
+  /** Computes e[l] = exp(i(phi0 + l dphi))
+    *
+    * Between exact evaluations the phase factors are advanced by the rotation exp(i dphi). The number of
+    * rotations in a row is limited such that the accumulated error stays within Get_Sincos_ULP().
+    */
+  void Exp_Linear_Phase( const double phi0, const double dphi, fftw_complex *e, const int64_t n )
+  {
+    int64_t rot = int64_t( (sincos_ulp-SC_POLY_ULP)/SC_ROTATION_ULP );
+    if ( rot > SC_MAX_ROTATIONS ) rot = SC_MAX_ROTATIONS;
+
+    if ( rot < 1 )
+    {
+      double phi[PHASE_BATCH];
+      for ( int64_t l0=0; l0<n; l0+=PHASE_BATCH )
+      {
+        const int64_t nb = ( n-l0 < PHASE_BATCH ) ? (n-l0) : (PHASE_BATCH);
+        for ( int64_t l=0; l<nb; l++ )
+          phi[l] = phi0 + double(l0+l)*dphi;
+        Exp_Phase( phi, e+l0, nb );
+      }
+      return;
+    }
+
+    // exact values at the seeds l = 0, rot+1, 2(rot+1), ...
+    const int64_t period = rot+1;
+    const int64_t no_seeds = (n+period-1)/period;
+    double phi[PHASE_BATCH];
+    fftw_complex seed[PHASE_BATCH];
+    fftw_complex w;
+    Exp_Phase( &dphi, &w, 1 );
+
+    for ( int64_t s0=0; s0<no_seeds; s0+=PHASE_BATCH )
+    {
+      const int64_t ns = ( no_seeds-s0 < PHASE_BATCH ) ? (no_seeds-s0) : (PHASE_BATCH);
+      for ( int64_t s=0; s<ns; s++ )
+        phi[s] = phi0 + double((s0+s)*period)*dphi;
+      Exp_Phase( phi, seed, ns );
+
+      for ( int64_t s=0; s<ns; s++ )
+      {
+        const int64_t l0 = (s0+s)*period;
+        const int64_t l1 = ( l0+period < n ) ? (l0+period) : (n);
+        double re = seed[s][0], im = seed[s][1];
+        e[l0][0] = re;
+        e[l0][1] = im;
+        for ( int64_t l=l0+1; l<l1; l++ )
+        {
+          const double tmp = re;
+          re = re*w[0] - im*w[1];
+          im = im*w[0] + tmp*w[1];
+          e[l][0] = re;
+          e[l][1] = im;
+        }
+      }
+    }
+  }
+
+  void Multiply_Phase( fftw_complex *data, const double *phi, const int64_t n )
+  {
+    fftw_complex ephi[PHASE_BATCH];
+    for ( int64_t l0=0; l0<n; l0+=PHASE_BATCH )
+    {
+      const int64_t nb = ( n-l0 < PHASE_BATCH ) ? (n-l0) : (PHASE_BATCH);
+      Exp_Phase( phi+l0, ephi, nb );
+      Multiply( data+l0, ephi, nb );
+    }
+  }
+
+  void Multiply_Linear_Phase( fftw_complex *data, const double phi0, const double dphi, const int64_t n )
+  {
+    fftw_complex ephi[PHASE_BATCH];
+    for ( int64_t l0=0; l0<n; l0+=PHASE_BATCH )
+    {
+      const int64_t nb = ( n-l0 < PHASE_BATCH ) ? (n-l0) : (PHASE_BATCH);
+      Exp_Linear_Phase( phi0+double(l0)*dphi, dphi, ephi, nb );
+      Multiply( data+l0, ephi, nb );
+    }
+  }
+
+  void Scale( fftw_complex *data, const double fak, const int64_t n )
+  {
+    double *a = reinterpret_cast<double *>(data);
+#ifdef TALISES_X86
+    if ( level == AVX512 ) { Scale_avx512( a, fak, n ); return; }
+    if ( level == AVX2 ) { Scale_avx2( a, fak, n ); return; }
+#endif
+    Scale_generic( a, fak, n );
+  }
+
+  void Swap_Scale_Alternating( fftw_complex *a, fftw_complex *b, const double fak_a, const double fak_b, const int64_t n )
+  {
+    double *x = reinterpret_cast<double *>(a);
+    double *y = reinterpret_cast<double *>(b);
+#ifdef TALISES_X86
+    if ( level == AVX512 ) { Swap_Scale_Alternating_avx512( x, y, fak_a, fak_b, n ); return; }
+    if ( level == AVX2 ) { Swap_Scale_Alternating_avx2( x, y, fak_a, fak_b, n ); return; }
+#endif
+    Swap_Scale_Alternating_generic( x, y, fak_a, fak_b, n );
+  }
+
+  void Swap_Scale_Alternating( fftw_complex *a, fftw_complex *b, const double fak, const int64_t n )
+  {
+    Swap_Scale_Alternating( a, b, fak, fak, n );
+  }
+
+  double Norm2( const fftw_complex *data, const int64_t n )
+  {
+    const double *a = reinterpret_cast<const double *>(data);
+#ifdef TALISES_X86
+    if ( level == AVX512 ) return Norm2_avx512( a, n );
+    if ( level == AVX2 ) return Norm2_avx2( a, n );
+#endif
+    return Norm2_generic( a, n );
+  }
+}
@@ -25,6 +25,8 @@
 #include "muParser.h"
 #include "ParameterHandler.h"
 #include "fftw3.h"
+#include "file_format.h"
+#include "output.h"
 
 using namespace std;
 
@@ -192,9 +194,9 @@ public:
       }
     }
 
-    ofstream ofs(filename);
-    ofs.write( reinterpret_cast<char *>(&m_header), sizeof(generic_header) );
-    ofs.write( reinterpret_cast<char *>(m_psi), sizeof(fftw_complex)*Ntot );
+    const int version = m_ph.Get_File_Format();
+    const std::vector<char> block = File_Format::Encode( m_header, version );
+    Output::Write_Parallel( filename, block.data(), block.size(), m_psi, sizeof(fftw_complex)*Ntot, false, File_Format::Alignment(version) );
   }
 
 protected:
@@ -0,0 +1,629 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "output.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define TALISES_IO_URING
+#endif
+#endif
+
+namespace Output
+{
+  namespace
+  {
+    /// Smallest region per thread, below this the threads only add overhead
+    const size_t MIN_REGION = size_t(1) << 22;
+    /// Regions start at multiples of this (relative to the data block)
+    const size_t REGION_ALIGN = 4096;
+    /// Largest single pwrite call (Linux transfers at most 0x7ffff000 bytes)
+    const size_t MAX_PWRITE = size_t(1) << 30;
+    /// Number of doubles collected before a buffer is handed to the writer thread
+    const size_t TS_BUFFER_SIZE = 8192;
+    /// Magic of binary time series files
+    const char TS_MAGIC[8] = {'T','L','S','T','S','0','0','1'};
+
+    /// Size of the chunks of a frame that are submitted to io_uring
+    const size_t URING_CHUNK = size_t(1) << 22;
+    /// Number of submission queue entries of the io_uring
+    const unsigned URING_ENTRIES = 32;
+
+    bool ends_with( const std::string &str, const std::string &suffix )
+    {
+      return str.size() >= suffix.size() && str.compare( str.size()-suffix.size(), suffix.size(), suffix ) == 0;
+    }
+
+    /// pwrite of the whole buffer, returns 0 or errno
+    int pwrite_all( const int fd, const char *buf, size_t n, off_t offset )
+    {
+      while ( n > 0 )
+      {
+        const ssize_t w = pwrite( fd, buf, ( n < MAX_PWRITE ) ? (n) : (MAX_PWRITE), offset );
+        if ( w < 0 )
+        {
+          if ( errno == EINTR ) continue;
+          return errno;
+        }
+        buf += w;
+        n -= size_t(w);
+        offset += w;
+      }
+      return 0;
+    }
+  }
+
+  void Write_Parallel( const std::string &filename, const void *header, const size_t header_size, const void *data, const size_t data_size, const bool append, const size_t alignment )
+  {
+    const int fd = open( filename.c_str(), O_WRONLY | O_CREAT | ( ( append ) ? (0) : (O_TRUNC) ), 0644 );
+    if ( fd < 0 ) throw std::string("Error in " + std::string(__func__) + ": could not open file " + filename + " (" + std::strerror(errno) + ")\n");
+
+    off_t base = 0;
+    if ( append )
+    {
+      struct stat st;
+      if ( fstat( fd, &st ) == 0 ) base = st.st_size;
+    }
+    const off_t data_offset = base + off_t(header_size);
+
+    // Allocate the final size first, the threads then only overwrite blocks of the file
+    const off_t frame_size = off_t((header_size + data_size + alignment - 1)/alignment*alignment);
+    int err = ( ftruncate( fd, base + frame_size ) == 0 ) ? (0) : (errno);
+    if ( err == 0 ) err = pwrite_all( fd, static_cast<const char *>(header), header_size, base );
+
+    int64_t no_regions = std::min<int64_t>( omp_get_max_threads(), int64_t(data_size/MIN_REGION) );
+    if ( no_regions < 1 ) no_regions = 1;
+    size_t region = (data_size + no_regions - 1)/no_regions;
+    region = (region + REGION_ALIGN - 1)/REGION_ALIGN*REGION_ALIGN;
+
+    const bool header_ok = ( err == 0 );
+    #pragma omp parallel for schedule(static) if(no_regions > 1)
+    for ( int64_t r=0; r<no_regions; r++ )
+    {
+      const size_t begin = size_t(r)*region;
+      if ( !header_ok || begin >= data_size ) continue;
+      const size_t n = ( data_size-begin < region ) ? (data_size-begin) : (region);
+      const int e = pwrite_all( fd, static_cast<const char *>(data)+begin, n, data_offset+off_t(begin) );
+      if ( e != 0 )
+      {
+        #pragma omp critical
+        err = e;
+      }
+    }
+
+    if ( close( fd ) != 0 && err == 0 ) err = errno;
+    if ( err != 0 ) throw std::string("Error in " + std::string(__func__) + ": could not write file " + filename + " (" + std::strerror(err) + ")\n");
+  }
+
+  Time_Series::Time_Series( const std::string &filename, const std::vector<std::string> &columns, const bool append )
+    : m_filename(filename), m_columns(columns), m_csv(ends_with(filename,".csv")), m_busy(false), m_stop(false)
+  {
+    if ( m_columns.empty() )
+      throw std::string("Error in " + std::string(__func__) + ": no columns for " + m_filename + "\n");
+    for ( auto &name : m_columns )
+    {
+      if ( name.size() >= COLUMN_NAME_SIZE )
+        throw std::string("Error in " + std::string(__func__) + ": column name " + name + " is too long\n");
+    }
+
+    // Header of a new file
+    std::string header;
+    if ( m_csv )
+    {
+      for ( size_t i=0; i<m_columns.size(); i++ )
+        header += ((i>0) ? (",") : ("")) + m_columns[i];
+      header += "\n";
+    }
+    else
+    {
+      const uint32_t no_cols = uint32_t(m_columns.size());
+      header.append( TS_MAGIC, sizeof(TS_MAGIC) );
+      header.append( reinterpret_cast<const char *>(&no_cols), sizeof(no_cols) );
+      for ( auto &name : m_columns )
+      {
+        header += name;
+        header.append( COLUMN_NAME_SIZE-name.size(), '\0' );
+      }
+    }
+
+    bool write_header = true;
+    if ( append )
+    {
+      std::ifstream in( m_filename, std::ifstream::binary );
+      std::string existing( header.size(), '\0' );
+      if ( in.is_open() && in.peek() != std::ifstream::traits_type::eof() )
+      {
+        in.read( &existing[0], header.size() );
+        if ( !in || existing != header )
+          throw std::string("Error in " + std::string(__func__) + ": cannot append to " + m_filename + ", the columns differ\n");
+        write_header = false;
+      }
+    }
+
+    m_file.open( m_filename, ( append ) ? (std::ofstream::binary | std::ofstream::app) : (std::ofstream::binary | std::ofstream::trunc) );
+    if ( !m_file.is_open() )
+      throw std::string("Error in " + std::string(__func__) + ": could not open file " + m_filename + "\n");
+    if ( write_header )
+      m_file.write( header.data(), header.size() );
+    m_file.flush();
+
+    m_buffer.reserve( TS_BUFFER_SIZE+m_columns.size() );
+    m_thread = std::thread( &Time_Series::worker, this );
+  }
+
+  Time_Series::~Time_Series()
+  {
+    try
+    {
+      Flush();
+    }
+    catch ( const std::string &str )
+    {
+      std::cerr << str;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond_work.notify_one();
+    m_thread.join();
+  }
+
+  void Time_Series::Push( const std::vector<double> &row )
+  {
+    if ( row.size() != m_columns.size() )
+      throw std::string("Error in " + std::string(__func__) + ": record for " + m_filename + " has the wrong number of columns\n");
+
+    m_buffer.insert( m_buffer.end(), row.begin(), row.end() );
+    if ( m_buffer.size() < TS_BUFFER_SIZE ) return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if ( !m_error.empty() ) throw m_error;
+    m_queue.push_back( std::move(m_buffer) );
+    lock.unlock();
+    m_cond_work.notify_one();
+
+    m_buffer = std::vector<double>();
+    m_buffer.reserve( TS_BUFFER_SIZE+m_columns.size() );
+  }
+
+  void Time_Series::Flush()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if ( !m_buffer.empty() )
+    {
+      m_queue.push_back( std::move(m_buffer) );
+      m_buffer = std::vector<double>();
+      m_cond_work.notify_one();
+    }
+    m_cond_done.wait( lock, [this] { return m_queue.empty() && !m_busy; } );
+    if ( !m_error.empty() ) throw m_error;
+  }
+
+  void Time_Series::worker()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while ( true )
+    {
+      m_cond_work.wait( lock, [this] { return m_stop || !m_queue.empty(); } );
+      if ( m_queue.empty() ) break; // m_stop and nothing left
+
+      std::vector<double> block = std::move(m_queue.front());
+      m_queue.pop_front();
+      m_busy = true;
+      lock.unlock();
+      write_block( block );
+      lock.lock();
+      m_busy = false;
+      if ( !m_file && m_error.empty() )
+        m_error = "Error in " + std::string(__func__) + ": could not write file " + m_filename + "\n";
+      if ( m_queue.empty() ) m_cond_done.notify_all();
+    }
+  }
+
+  void Time_Series::write_block( const std::vector<double> &block )
+  {
+    if ( m_csv )
+    {
+      std::string text;
+      char number[32];
+      for ( size_t i=0; i<block.size(); i++ )
+      {
+        snprintf( number, sizeof(number), "%.17g", block[i] );
+        text += number;
+        text += ( (i+1) % m_columns.size() == 0 ) ? ('\n') : (',');
+      }
+      m_file.write( text.data(), text.size() );
+    }
+    else
+    {
+      m_file.write( reinterpret_cast<const char *>(block.data()), sizeof(double)*block.size() );
+    }
+    m_file.flush();
+  }
+
+#ifdef TALISES_IO_URING
+  /// Minimal io_uring with the raw system calls, only used for writes of a single thread
+  struct Async_Writer::Uring
+  {
+    int fd;
+    unsigned entries;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+
+    Uring() : fd(-1), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sq_size(0), cq_size(0), sqes_size(0), sqes(static_cast<io_uring_sqe *>(MAP_FAILED)) {}
+
+    ~Uring()
+    {
+      if ( sqes != MAP_FAILED ) munmap( sqes, sqes_size );
+      if ( cq_ptr != MAP_FAILED && cq_ptr != sq_ptr ) munmap( cq_ptr, cq_size );
+      if ( sq_ptr != MAP_FAILED ) munmap( sq_ptr, sq_size );
+      if ( fd >= 0 ) close( fd );
+    }
+
+    /// Sets up the rings, false if io_uring is not available (old kernel, seccomp, ...)
+    bool Init()
+    {
+      io_uring_params p;
+      std::memset( &p, 0, sizeof(p) );
+      fd = int(syscall( __NR_io_uring_setup, URING_ENTRIES, &p ));
+      if ( fd < 0 ) return false;
+      entries = p.sq_entries;
+
+      sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+      cq_size = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+      if ( p.features & IORING_FEAT_SINGLE_MMAP ) sq_size = cq_size = std::max( sq_size, cq_size );
+
+      sq_ptr = mmap( nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+      if ( sq_ptr == MAP_FAILED ) return false;
+      cq_ptr = ( p.features & IORING_FEAT_SINGLE_MMAP ) ? (sq_ptr) : (mmap( nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING ));
+      if ( cq_ptr == MAP_FAILED ) return false;
+      sqes_size = p.sq_entries*sizeof(io_uring_sqe);
+      sqes = static_cast<io_uring_sqe *>(mmap( nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES ));
+      if ( sqes == MAP_FAILED ) return false;
+
+      char *sq = static_cast<char *>(sq_ptr);
+      char *cq = static_cast<char *>(cq_ptr);
+      sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+      sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+      sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+      cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+      cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+      cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+      cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+
+      // IORING_OP_WRITE needs Linux 5.6, probe it with a write to /dev/null
+      const int null_fd = open( "/dev/null", O_WRONLY );
+      if ( null_fd < 0 ) return false;
+      const char probe = 0;
+      const bool ok = ( Write_All( null_fd, &probe, 1, 0 ) == 0 );
+      close( null_fd );
+      return ok;
+    }
+
+    /// Writes n bytes in chunks of URING_CHUNK, returns 0 or errno
+    int Write_All( const int file, const char *buf, const size_t n, const off_t offset )
+    {
+      size_t next = 0;
+      unsigned inflight = 0;
+      int err = 0;
+      std::vector<std::pair<size_t,size_t>> rest; // short writes, finished with pwrite
+
+      while ( ( next < n && err == 0 ) || inflight > 0 )
+      {
+        unsigned submit = 0;
+        unsigned tail = *sq_tail;
+        while ( next < n && err == 0 && inflight < entries )
+        {
+          const unsigned idx = tail & *sq_mask;
+          const size_t len = std::min( URING_CHUNK, n-next );
+          io_uring_sqe *sqe = &sqes[idx];
+          std::memset( sqe, 0, sizeof(io_uring_sqe) );
+          sqe->opcode = IORING_OP_WRITE;
+          sqe->fd = file;
+          sqe->addr = reinterpret_cast<uint64_t>(buf+next);
+          sqe->len = unsigned(len);
+          sqe->off = uint64_t(offset) + next;
+          sqe->user_data = next;
+          sq_array[idx] = idx;
+          tail++;
+          next += len;
+          inflight++;
+          submit++;
+        }
+        __atomic_store_n( sq_tail, tail, __ATOMIC_RELEASE );
+
+        if ( syscall( __NR_io_uring_enter, fd, submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0 ) < 0 )
+        {
+          if ( errno == EINTR ) continue;
+          return errno; // the queued writes were not consumed
+        }
+
+        unsigned head = *cq_head;
+        const unsigned cq_end = __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE );
+        for ( ; head != cq_end; head++ )
+        {
+          const io_uring_cqe &cqe = cqes[head & *cq_mask];
+          const size_t begin = size_t(cqe.user_data);
+          const size_t len = std::min( URING_CHUNK, n-begin );
+          if ( cqe.res < 0 )
+          {
+            if ( err == 0 ) err = -cqe.res;
+          }
+          else if ( size_t(cqe.res) < len )
+          {
+            rest.push_back( { begin+size_t(cqe.res), len-size_t(cqe.res) } );
+          }
+          inflight--;
+        }
+        __atomic_store_n( cq_head, head, __ATOMIC_RELEASE );
+      }
+
+      for ( auto &r : rest )
+        if ( err == 0 ) err = pwrite_all( file, buf+r.first, r.second, offset+off_t(r.first) );
+      return err;
+    }
+  };
+#else
+  struct Async_Writer::Uring
+  {
+    bool Init() { return false; }
+    int Write_All( const int, const char *, const size_t, const off_t ) { return ENOSYS; }
+  };
+#endif
+
+  Async_Writer::Async_Writer( const int no_io_threads, const size_t max_pending )
+    : m_ring(new Uring), m_stop_pool(false), m_max_pending(std::max<size_t>(max_pending,1)), m_busy(false), m_stop(false)
+  {
+    if ( !m_ring->Init() )
+    {
+      m_ring.reset();
+      for ( int i=0; i<std::max(no_io_threads,1); i++ )
+      {
+        m_pool.emplace_back( [this]
+        {
+          std::unique_lock<std::mutex> lock(m_task_mutex);
+          while ( true )
+          {
+            m_cond_tasks.wait( lock, [this] { return m_stop_pool || !m_tasks.empty(); } );
+            if ( m_tasks.empty() ) break;
+            std::function<void()> task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+          }
+        } );
+      }
+    }
+    m_thread = std::thread( &Async_Writer::worker, this );
+  }
+
+  Async_Writer::~Async_Writer()
+  {
+    try
+    {
+      Wait();
+    }
+    catch ( const std::string &str )
+    {
+      std::cerr << str;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cond_work.notify_one();
+    m_thread.join();
+
+    {
+      std::lock_guard<std::mutex> lock(m_task_mutex);
+      m_stop_pool = true;
+    }
+    m_cond_tasks.notify_all();
+    for ( auto &t : m_pool )
+      t.join();
+
+    for ( auto &b : m_free_buffers )
+      free( b.first );
+  }
+
+  void Async_Writer::Submit( const std::string &filename, const void *header, const size_t header_size, const void *data, const size_t data_size, const bool append, const size_t alignment )
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond_done.wait( lock, [this] { return m_queue.size() < m_max_pending || !m_error.empty(); } );
+      if ( !m_error.empty() ) throw m_error;
+    }
+
+    Job job;
+    job.filename = filename;
+    job.append = append;
+    job.frame_size = (header_size + data_size + alignment - 1)/alignment*alignment;
+    const size_t buffer_size = (job.frame_size + ALIGNMENT - 1)/ALIGNMENT*ALIGNMENT;
+
+    // Reuse a written buffer, new ones are slow because of the page faults
+    job.buffer = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for ( auto it=m_free_buffers.begin(); it!=m_free_buffers.end(); ++it )
+      {
+        if ( it->second < buffer_size ) continue;
+        job.buffer = it->first;
+        job.capacity = it->second;
+        m_free_buffers.erase(it);
+        break;
+      }
+    }
+    if ( job.buffer == nullptr )
+    {
+      void *buffer = nullptr;
+      if ( posix_memalign( &buffer, ALIGNMENT, buffer_size ) != 0 )
+        throw std::string("Error in " + std::string(__func__) + ": could not allocate the output buffer for " + filename + "\n");
+      job.buffer = static_cast<char *>(buffer);
+      job.capacity = buffer_size;
+    }
+
+    std::memcpy( job.buffer, header, header_size );
+    std::memset( job.buffer+header_size+data_size, 0, buffer_size-header_size-data_size );
+    const char *src = static_cast<const char *>(data);
+    const int64_t no_chunks = int64_t((data_size + MIN_REGION - 1)/MIN_REGION);
+    #pragma omp parallel for if(no_chunks > 1)
+    for ( int64_t c=0; c<no_chunks; c++ )
+    {
+      const size_t begin = size_t(c)*MIN_REGION;
+      std::memcpy( job.buffer+header_size+begin, src+begin, std::min( MIN_REGION, data_size-begin ) );
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queue.push_back( job );
+    }
+    m_cond_work.notify_one();
+  }
+
+  void Async_Writer::Wait()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond_done.wait( lock, [this] { return m_queue.empty() && !m_busy; } );
+    if ( !m_error.empty() )
+    {
+      const std::string err = m_error;
+      m_error.clear();
+      throw err;
+    }
+  }
+
+  void Async_Writer::worker()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while ( true )
+    {
+      m_cond_work.wait( lock, [this] { return m_stop || !m_queue.empty(); } );
+      if ( m_queue.empty() ) break; // m_stop and nothing left
+
+      const Job job = m_queue.front();
+      m_busy = true;
+      lock.unlock();
+      std::string err;
+      try
+      {
+        write_job( job );
+      }
+      catch ( const std::string &str )
+      {
+        err = str;
+      }
+      lock.lock();
+      m_free_buffers.push_back( { job.buffer, job.capacity } );
+      if ( m_free_buffers.size() > m_max_pending ) // keep the largest ones
+      {
+        auto smallest = std::min_element( m_free_buffers.begin(), m_free_buffers.end(), []( const std::pair<char *,size_t> &a, const std::pair<char *,size_t> &b ) { return a.second < b.second; } );
+        free( smallest->first );
+        m_free_buffers.erase( smallest );
+      }
+      m_queue.pop_front();
+      m_busy = false;
+      if ( !err.empty() && m_error.empty() ) m_error = err;
+      m_cond_done.notify_all();
+    }
+  }
+
+  void Async_Writer::write_job( const Job &job )
+  {
+    const int fd = open( job.filename.c_str(), O_WRONLY | O_CREAT | ( ( job.append ) ? (0) : (O_TRUNC) ), 0644 );
+    if ( fd < 0 ) throw std::string("Error in " + std::string(__func__) + ": could not open file " + job.filename + " (" + std::strerror(errno) + ")\n");
+
+    off_t base = 0;
+    if ( job.append )
+    {
+      struct stat st;
+      if ( fstat( fd, &st ) == 0 ) base = st.st_size;
+    }
+
+    // Direct I/O needs aligned offsets and sizes, the buffer is always aligned
+    const int flags = fcntl( fd, F_GETFL );
+    bool direct = ( base % off_t(ALIGNMENT) == 0 && job.frame_size % ALIGNMENT == 0 && fcntl( fd, F_SETFL, flags | O_DIRECT ) == 0 );
+
+    int err = ( m_ring ) ? (m_ring->Write_All( fd, job.buffer, job.frame_size, base )) : (write_regions( fd, job.buffer, job.frame_size, base ));
+    if ( err == EINVAL && direct ) // file system without O_DIRECT
+    {
+      direct = false;
+      fcntl( fd, F_SETFL, flags );
+      err = ( m_ring ) ? (m_ring->Write_All( fd, job.buffer, job.frame_size, base )) : (write_regions( fd, job.buffer, job.frame_size, base ));
+    }
+
+    // Keep the page cache for the simulation, the written pages are not read again
+    if ( err == 0 && !direct )
+    {
+      if ( fdatasync( fd ) != 0 ) err = errno;
+      posix_fadvise( fd, base, off_t(job.frame_size), POSIX_FADV_DONTNEED );
+    }
+
+    if ( close( fd ) != 0 && err == 0 ) err = errno;
+    if ( err != 0 ) throw std::string("Error in " + std::string(__func__) + ": could not write file " + job.filename + " (" + std::strerror(err) + ")\n");
+  }
+
+  /// Writes n bytes with the pwrite threads, returns 0 or errno
+  int Async_Writer::write_regions( const int fd, const char *buf, const size_t n, const off_t offset )
+  {
+    const size_t no_regions = std::max<size_t>( 1, std::min<size_t>( m_pool.size(), n/MIN_REGION ) );
+    const size_t region = ((n + no_regions - 1)/no_regions + ALIGNMENT - 1)/ALIGNMENT*ALIGNMENT;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t remaining = 0;
+    int err = 0;
+    {
+      std::lock_guard<std::mutex> lock(m_task_mutex);
+      for ( size_t begin=0; begin<n; begin+=region )
+      {
+        const size_t len = std::min( region, n-begin );
+        remaining++;
+        m_tasks.push_back( [&, begin, len]
+        {
+          const int e = pwrite_all( fd, buf+begin, len, offset+off_t(begin) );
+          std::lock_guard<std::mutex> lock(mutex);
+          if ( e != 0 && err == 0 ) err = e;
+          if ( --remaining == 0 ) cond.notify_one();
+        } );
+      }
+    }
+    m_cond_tasks.notify_all();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait( lock, [&] { return remaining == 0; } );
+    return err;
+  }
+}
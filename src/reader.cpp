@@ -0,0 +1,189 @@
+// This file is part of TALISES.
+//
+// TALISES is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// TALISES is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with TALISES.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2020 Sascha Vowe
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "reader.h"
+
+namespace Reader
+{
+  namespace
+  {
+    /// |value|^2 of entry l of a complex or real frame
+    inline double norm2( const Grid_View &view, const int64_t l )
+    {
+      if ( view.data != nullptr ) return std::norm(view.data[l]);
+      return view.real_data[l]*view.real_data[l];
+    }
+  }
+
+  double Grid_View::Volume_Element() const
+  {
+    double retval = 1;
+    for ( int i=0; i<dims; i++ )
+      retval *= dx[i];
+    return retval;
+  }
+
+  File::File( const std::string &filename ) : m_filename(filename), m_map(nullptr), m_size(0)
+  {
+    const int fd = open( filename.c_str(), O_RDONLY );
+    if ( fd < 0 ) throw std::string("Error in " + std::string(__func__) + ": could not open file " + filename + " (" + std::strerror(errno) + ")\n");
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size == 0 )
+    {
+      close( fd );
+      throw std::string("Error in " + std::string(__func__) + ": " + filename + " contains no header\n");
+    }
+    m_size = size_t(st.st_size);
+
+    m_map = mmap( nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( m_map == MAP_FAILED )
+    {
+      m_map = nullptr;
+      throw std::string("Error in " + std::string(__func__) + ": could not map file " + filename + " (" + std::strerror(errno) + ")\n");
+    }
+
+    // Index the frames, each one is a header followed by the data of the grid
+    const char *base = static_cast<const char *>(m_map);
+    size_t offset = 0;
+    while ( offset < m_size )
+    {
+      Frame frame;
+      uint64_t data_offset, frame_size;
+      File_Format::Decode( base+offset, m_size-offset, frame.header, data_offset, frame_size );
+
+      const generic_header &header = frame.header;
+      if ( header.nDims < 1 || header.nDims > 3 || ( header.nDatatyp != sizeof(double) && header.nDatatyp != 2*sizeof(double) ) )
+        throw std::string("Error in " + std::string(__func__) + ": invalid header at byte " + std::to_string(offset) + " of " + filename + "\n");
+      if ( offset + data_offset + File_Format::Data_Size(header) > m_size )
+        throw std::string("Error in " + std::string(__func__) + ": " + filename + " is truncated\n");
+
+      frame.data = base+offset+data_offset;
+      m_frames.push_back( frame );
+      offset += frame_size;
+    }
+
+    madvise( m_map, m_size, MADV_RANDOM );
+
+    m_by_time.resize( m_frames.size() );
+    for ( size_t i=0; i<m_by_time.size(); i++ )
+      m_by_time[i] = i;
+    std::stable_sort( m_by_time.begin(), m_by_time.end(), [this]( const size_t a, const size_t b ) { return m_frames[a].header.t < m_frames[b].header.t; } );
+  }
+
+  File::File( File &&other ) : m_filename(std::move(other.m_filename)), m_map(other.m_map), m_size(other.m_size),
+    m_frames(std::move(other.m_frames)), m_by_time(std::move(other.m_by_time))
+  {
+    other.m_map = nullptr;
+    other.m_size = 0;
+  }
+
+  File::~File()
+  {
+    if ( m_map != nullptr ) munmap( m_map, m_size );
+  }
+
+  Grid_View File::Get_View( const size_t frame ) const
+  {
+    if ( frame >= m_frames.size() ) throw std::string("Error in " + std::string(__func__) + ": frame out of bounds\n");
+
+    const generic_header *header = &m_frames[frame].header;
+    const bool cmplx = ( header->nDatatyp == 2*sizeof(double) );
+
+    Grid_View view;
+    view.header = header;
+    view.data = ( cmplx ) ? (reinterpret_cast<const std::complex<double> *>(m_frames[frame].data)) : (nullptr);
+    view.real_data = ( cmplx ) ? (nullptr) : (reinterpret_cast<const double *>(m_frames[frame].data));
+    view.dims = int(header->nDims);
+
+    const long long n[3] = { header->nDimX, header->nDimY, header->nDimZ };
+    const double x0[3] = { header->xMin, header->yMin, header->zMin };
+    const double dx[3] = { header->dx, header->dy, header->dz };
+    for ( int i=0; i<3; i++ )
+    {
+      view.n[i] = ( i < view.dims ) ? (n[i]) : (1);
+      view.x0[i] = ( i < view.dims ) ? (x0[i]) : (0);
+      view.dx[i] = ( i < view.dims ) ? (dx[i]) : (1);
+    }
+    return view;
+  }
+
+  size_t File::Find( const double t ) const
+  {
+    if ( m_frames.empty() ) throw std::string("Error in " + std::string(__func__) + ": " + m_filename + " has no frames\n");
+
+    auto it = std::lower_bound( m_by_time.begin(), m_by_time.end(), t, [this]( const size_t a, const double t ) { return m_frames[a].header.t < t; } );
+    if ( it == m_by_time.end() ) return m_by_time.back();
+    if ( it != m_by_time.begin() && std::fabs(m_frames[*(it-1)].header.t-t) <= std::fabs(m_frames[*it].header.t-t) ) return *(it-1);
+    return *it;
+  }
+
+  double Particle_Number( const Grid_View &view )
+  {
+    const int64_t size = view.Size();
+    double retval = 0;
+    #pragma omp parallel for reduction(+:retval)
+    for ( int64_t l=0; l<size; l++ )
+      retval += norm2( view, l );
+    return retval*view.Volume_Element();
+  }
+
+  void Density( const Grid_View &view, std::vector<double> &density )
+  {
+    const int64_t size = view.Size();
+    density.resize( size );
+    #pragma omp parallel for
+    for ( int64_t l=0; l<size; l++ )
+      density[l] = norm2( view, l );
+  }
+
+  void Slice( const Grid_View &view, const int axis, const int64_t index, std::vector<double> &slice )
+  {
+    if ( axis < 0 || axis >= view.dims ) throw std::string("Error in " + std::string(__func__) + ": axis out of bounds\n");
+    if ( index < 0 || index >= view.n[axis] ) throw std::string("Error in " + std::string(__func__) + ": index out of bounds\n");
+
+    // The fixed axis gets extent 1, the loops run over the remaining axes
+    int64_t n[3] = { view.n[0], view.n[1], view.n[2] };
+    int64_t i0[3] = { 0, 0, 0 };
+    n[axis] = 1;
+    i0[axis] = index;
+
+    slice.resize( n[0]*n[1]*n[2] );
+    #pragma omp parallel for collapse(2)
+    for ( int64_t i=0; i<n[0]; i++ )
+      for ( int64_t j=0; j<n[1]; j++ )
+        for ( int64_t k=0; k<n[2]; k++ )
+          slice[(i*n[1]+j)*n[2]+k] = norm2( view, view.Index( i0[0]+i, i0[1]+j, i0[2]+k ) );
+  }
+
+  std::vector<double> Populations( const std::vector<const File *> &components, const double t )
+  {
+    std::vector<double> retval;
+    for ( auto file : components )
+      retval.push_back( Particle_Number( file->Get_View( file->Find(t) ) ) );
+    return retval;
+  }
+}
@@ -22,12 +22,24 @@
 #include "cft_1d.h"
 #include "cft_2d.h"
 #include "cft_3d.h"
+#include "complex_kernels.h"
 #include "muParser.h"
 #include "ParameterHandler.h"
 #include "CRT_Base_IF.h"
+#include "autotune.h"
+#ifdef TALISES_MPI
+#include <mpi.h>
+#include "cft_3d_mpi.h"
+#endif
 
 using namespace std;
 
+#ifdef TALISES_MPI
+typedef Fourier::cft_3d_mpi cft_3d_type; // slab decomposition over all processes
+#else
+typedef Fourier::cft_3d cft_3d_type;
+#endif
+
 namespace RT_Solver
 {
   template<class T, int dim, int internal_dim>
@@ -52,14 +64,45 @@ namespace RT_Solver
     // return true if a custom sequence is found or else
     return false;
   }
+
+  /// Propagates all sequences or, with plan_only, only estimates their cost
+  template<class S>
+  void Run( S &rtsol, const bool plan_only )
+  {
+    if ( plan_only )
+      rtsol.plan_sequence();
+    else
+      rtsol.run_sequence();
+  }
 }
 
 int main( int argc, char *argv[] ){
-  if ( argc != 2 )
+  if ( argc < 2 )
   {
     printf( "No parameter xml file specified.\n" );
     return EXIT_FAILURE;
   }
+  // --plan: estimate wall time, memory and output without propagating
+  const bool plan_only = ( argc == 3 && strcmp( argv[2], "--plan" ) == 0 );
+  if ( argc > 3 || ( argc == 3 && !plan_only ) )
+  {
+    printf( "Usage: %s file.xml [--plan]\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+
+#ifdef TALISES_MPI
+  int provided, rank, no_ranks;
+  MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &provided );
+  MPI_Comm_rank( MPI_COMM_WORLD, &rank );
+  MPI_Comm_size( MPI_COMM_WORLD, &no_ranks );
+  // OpenMP threads run the grid loops, MPI is only called by the master thread
+  if ( provided < MPI_THREAD_FUNNELED )
+  {
+    if ( rank == 0 ) std::cerr << "Error: the MPI library does not provide MPI_THREAD_FUNNELED, which is required together with OpenMP\n";
+    MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+  }
+  if ( rank != 0 ) std::cout.rdbuf( nullptr ); // only rank 0 reports
+#endif
 
   ParameterHandler params(argv[1]);
   int dim=0;
@@ -82,60 +125,124 @@ int main( int argc, char *argv[] ){
     cout << "Errc:     " << e.GetCode() << "\n";
   }
 
-  no_of_threads = std::stod(params.Get_simulation("N_THREADS"));
-
+  // N_THREADS auto selects threads, planner flags and kernels with Autotune
+  std::string threads_str = params.Get_simulation("N_THREADS");
   char *envstr = getenv( "MY_NO_OF_THREADS" );
-  if ( envstr != nullptr ) no_of_threads = atoi( envstr );
+  if ( envstr != nullptr ) threads_str = envstr;
+  const bool autotune = ( threads_str == "auto" );
+  bool export_wisdom = false;
+  no_of_threads = ( autotune ) ? (omp_get_num_procs()) : (std::stod(threads_str));
 
   fftw_init_threads();
+
+  if ( autotune )
+  {
+    try
+    {
+#ifdef TALISES_MPI
+      if ( no_ranks > 1 ) throw std::string("FYI: no autotuning for distributed grids\n");
+#endif
+      generic_header header;
+      File_Format::Read_Header( params.Get_simulation("FILENAME"), header );
+      const std::string fingerprint = Autotune::Fingerprint( header, internal_dim, no_of_threads );
+      const std::string cache = Autotune::Cache_File();
+      Autotune::config cfg;
+      if ( Autotune::Load( cache, fingerprint, cfg ) )
+      {
+        std::cout << "FYI: autotune settings from " << cache << "\n";
+        // plans with FFTW_MEASURE are only cheap to create with the wisdom of earlier runs
+        if ( cfg.planner_flags != FFTW_ESTIMATE ) Autotune::Import_Wisdom();
+      }
+      else
+      {
+        if ( dim == 1 ) cfg = Autotune::Tune<Fourier::cft_1d>( header, internal_dim, no_of_threads );
+        else if ( dim == 2 ) cfg = Autotune::Tune<Fourier::cft_2d>( header, internal_dim, no_of_threads );
+        else if ( dim == 3 ) cfg = Autotune::Tune<cft_3d_type>( header, internal_dim, no_of_threads );
+        else throw std::string("Error: no autotuning for DIM " + std::to_string(dim) + "\n");
+        Autotune::Store( cache, fingerprint, cfg );
+      }
+      export_wisdom = ( cfg.planner_flags != FFTW_ESTIMATE );
+      if ( export_wisdom ) Autotune::Export_Wisdom();
+      no_of_threads = cfg.threads;
+      Fourier::Set_Planner_Flags( cfg.planner_flags );
+      Kernels::Set_SIMD_Level( cfg.simd );
+      std::cout << "FYI: FFTW planner      : " << Autotune::Planner_Name( cfg.planner_flags ) << "\n";
+    }
+    catch (std::string &str)
+    {
+      cout << str << endl;
+    }
+  }
+
   fftw_plan_with_nthreads( no_of_threads );
   omp_set_num_threads( no_of_threads );
 
   std::cout << "FYI: Number of threads : " << no_of_threads << "\n";
 
+  envstr = getenv( "MY_SIMD_LEVEL" );
+  try
+  {
+    if ( envstr != nullptr ) Kernels::Set_SIMD_Level( std::string(envstr) );
+  }
+  catch (std::string &str)
+  {
+    cout << str << endl;
+  }
+  std::cout << "FYI: SIMD kernels      : " << Kernels::Get_SIMD_Name(Kernels::Get_SIMD_Level()) << "\n";
+
+  envstr = getenv( "MY_SINCOS_ULP" );
+  if ( envstr != nullptr ) Kernels::Set_Sincos_ULP( atof( envstr ) );
+  std::cout << "FYI: Sincos tolerance  : " << Kernels::Get_Sincos_ULP() << " ulp\n";
+#ifdef TALISES_MPI
+  std::cout << "FYI: MPI processes     : " << no_ranks << "\n";
+#endif
+
   try //TODO hardcode more options for internal levels lol
   {
+#ifdef TALISES_MPI
+    if ( dim != 3 && no_ranks > 1 ) throw std::string("Error: only 3D grids can be distributed over several MPI processes\n");
+#endif
     if ( dim == 1 )
     {
 		if (internal_dim == 1)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,1> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	if (internal_dim == 2)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,2> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 3)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,3> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 4)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,4> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 5)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,5> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 6)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,6> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 7)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,7> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 8)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_1d,1,8> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     }
     else if ( dim == 2 )
@@ -143,85 +250,85 @@ int main( int argc, char *argv[] ){
 		if (internal_dim == 1)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,1> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	if (internal_dim == 2)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,2> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 3)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,3> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 4)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,4> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 5)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,5> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 6)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,6> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 7)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,7> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 8)
     	{
 		  RT_Solver::Raman_single<Fourier::cft_2d,2,8> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     }
     else if ( dim == 3 )
     {
 		if (internal_dim == 1)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,1> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,1> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	if (internal_dim == 2)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,2> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,2> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 3)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,3> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,3> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 4)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,4> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,4> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 5)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,5> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,5> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 6)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,6> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,6> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 7)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,7> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,7> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     	else if (internal_dim == 8)
     	{
-		  RT_Solver::Raman_single<Fourier::cft_3d,3,8> rtsol( &params );
-		  rtsol.run_sequence();
+		  RT_Solver::Raman_single<cft_3d_type,3,8> rtsol( &params );
+		  RT_Solver::Run( rtsol, plan_only );
     	}
     }
     else
@@ -242,6 +349,12 @@ int main( int argc, char *argv[] ){
     cout << str << endl;
   }
 
+  // adds the plans of this run (convolution, co-moving frame, ...) to the wisdom
+  if ( export_wisdom ) Autotune::Export_Wisdom();
+
   fftw_cleanup_threads();
+#ifdef TALISES_MPI
+  MPI_Finalize();
+#endif
   return EXIT_SUCCESS;
 }